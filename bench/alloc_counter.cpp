@@ -0,0 +1,72 @@
+/*!
+ * @file bench/alloc_counter.cpp
+ *
+ * @brief This file contains a counting hook on the global allocator.
+ */
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "alloc_counter.hpp"
+
+static std::atomic<size_t> g_alloc_bytes(0);
+static std::atomic<size_t> g_alloc_count(0);
+static std::atomic<size_t> g_alloc_live(0);
+
+/*!
+ * @brief This function allocates and records a block.
+ */
+static void *
+counted_alloc (size_t size)
+{
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+
+    void * p = malloc(size ? size : 1);
+    if (!p)
+    {
+        // Built without exceptions, so there is no bad_alloc to throw.
+        abort();
+    }
+
+    g_alloc_live.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    return p;
+}
+
+/*!
+ * @brief This function releases and records a block.
+ */
+static void
+counted_free (void * p)
+{
+    if (p)
+    {
+        g_alloc_live.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+        free(p);
+    }
+}
+
+void * operator new (size_t size) { return counted_alloc(size); }
+void * operator new[] (size_t size) { return counted_alloc(size); }
+void operator delete (void * p) noexcept { counted_free(p); }
+void operator delete[] (void * p) noexcept { counted_free(p); }
+void operator delete (void * p, size_t) noexcept { counted_free(p); }
+void operator delete[] (void * p, size_t) noexcept { counted_free(p); }
+
+/*!
+ * @brief This function returns the allocation totals so far.
+ */
+AllocCounts
+alloc_counts (void)
+{
+    AllocCounts c;
+    c.bytes = g_alloc_bytes.load(std::memory_order_relaxed);
+    c.count = g_alloc_count.load(std::memory_order_relaxed);
+    c.live = g_alloc_live.load(std::memory_order_relaxed);
+    return c;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,34 @@
+/*!
+ * @file bench/alloc_counter.hpp
+ *
+ * @brief This file contains a counting hook on the global allocator.
+ *
+ *          Linking alloc_counter.cpp into a benchmark replaces the global
+ *              operator new/delete with versions that count calls and
+ *              bytes requested, and track the bytes currently live.
+ */
+
+#ifndef _LLVM_ALLOC_COUNTER_H
+#define _LLVM_ALLOC_COUNTER_H
+
+#include <cstddef>
+
+/*!
+ * @brief This struct holds the allocation totals since process start.
+ */
+struct AllocCounts
+{
+    size_t bytes = 0;   // Bytes requested.
+    size_t count = 0;   // Allocations made.
+    size_t live = 0;    // Bytes currently allocated, as usable size.
+};
+
+/*!
+ * @brief This function returns the allocation totals so far.
+ */
+AllocCounts
+alloc_counts (void);
+
+#endif // _LLVM_ALLOC_COUNTER_H
+
+/***   end of file   ***/
@@ -0,0 +1,206 @@
+/*!
+ * @file bench/bench_aot.cpp
+ *
+ * @brief This file contains the whole-program AOT comparison.
+ *
+ *          Each program in bench/runtime is compiled ahead of time to a
+ *              shared object twice at each level: as usual, with every
+ *              function external, and as a whole program exporting only
+ *              "kernel". The object and shared object sizes and the time
+ *              per call of kernel(x) are reported for both, and the two
+ *              must compute the same result.
+ *
+ *          Usage: bench_aot [--dir bench/runtime] [--levels 0,2]
+ *                           [--program NAME] [--reps R]
+ */
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "bench_util.hpp"
+#include "program.hpp"
+
+// The suite, and the argument each kernel is called with.
+static const struct
+{
+    const char * p_name;
+    double arg;
+} programs[] = {
+    { "fib", 1.0 },
+    { "newton", 3.0 },
+    { "integrate", 2.0 },
+    { "mandelbrot", -1.0 },
+    { "poly", 0.5 },
+};
+
+typedef double (*KernelFn)(double);
+
+// Keeps the kernel results live.
+static volatile double g_sink;
+
+/*!
+ * @brief This function times a kernel, calibrating the number of calls so
+ *          that each sample takes at least 50ms.
+ *
+ * @return The median time per call in nanoseconds.
+ */
+static double
+time_kernel (KernelFn p_fn, double arg, int reps)
+{
+    long calls = 1;
+    for (;;)
+    {
+        double start = bench_now();
+        for (long i = 0; i < calls; ++i)
+        {
+            g_sink = p_fn(arg);
+        }
+        if (bench_now() - start >= 0.05)
+        {
+            break;
+        }
+        calls *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < reps; ++r)
+    {
+        double start = bench_now();
+        for (long i = 0; i < calls; ++i)
+        {
+            g_sink = p_fn(arg);
+        }
+        samples.push_back((bench_now() - start) / calls * 1e9);
+    }
+
+    return bench_stats(samples).median;
+}
+
+/*!
+ * @brief This function compiles a program to a shared object and loads it.
+ *
+ * @param whole_program Whether to internalize everything but "kernel".
+ * @param object_size Receives the size of the object file.
+ * @param so_size Receives the size of the linked shared object.
+ *
+ * @return The kernel, or nullptr on error.
+ */
+static KernelFn
+build (const std::string& path, int opt_level, bool whole_program,
+       size_t& object_size, size_t& so_size)
+{
+    std::string text;
+    if (!read_file(path.c_str(), text))
+    {
+        return nullptr;
+    }
+
+    init_native_target(opt_level);
+    init_module("aot");
+    g_function_protos.clear();
+
+    std::vector<Item> items;
+    if (!parse_program(text, items) || !codegen_program(items))
+    {
+        return nullptr;
+    }
+
+    if (whole_program)
+    {
+        internalize_module(*g_module, { "kernel" });
+    }
+    optimize_module(*g_module, opt_level);
+
+    llvm::SmallVector<char, 0> object;
+    if (!emit_object(*g_module, object))
+    {
+        return nullptr;
+    }
+    object_size = object.size();
+
+    static int n_built = 0;
+    std::string so = "/tmp/bench_aot_" + std::to_string(getpid())
+        + "_" + std::to_string(n_built++) + ".so";
+    if (!link_object(object, so, true))
+    {
+        return nullptr;
+    }
+
+    struct stat st;
+    so_size = 0 == stat(so.c_str(), &st) ? st.st_size : 0;
+
+    void * p_lib = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+    unlink(so.c_str());
+    if (!p_lib)
+    {
+        fprintf(stderr, "Error: %s\n", dlerror());
+        return nullptr;
+    }
+
+    return (KernelFn) dlsym(p_lib, "kernel");
+}
+
+int main (int argc, char ** argv)
+{
+    std::string dir = bench_arg(argc, argv, "--dir", "bench/runtime");
+    std::string levels = bench_arg(argc, argv, "--levels", "0,2");
+    const char * p_only = bench_arg(argc, argv, "--program", nullptr);
+    int reps = atoi(bench_arg(argc, argv, "--reps", "5"));
+
+    install_binop_precedence();
+
+    printf("%-12s %4s %-8s %10s %10s %12s %8s\n",
+           "program", "opt", "mode", "obj bytes", "so bytes", "ns/call", "speedup");
+
+    for (const auto& prog : programs)
+    {
+        if (p_only && 0 != strcmp(p_only, prog.p_name))
+        {
+            continue;
+        }
+
+        for (const char * p = levels.c_str(); *p; )
+        {
+            char * p_end;
+            int opt_level = (int) strtol(p, &p_end, 10);
+            p = *p_end ? p_end + 1 : p_end;
+
+            std::string path = dir + "/" + prog.p_name + ".ks";
+            size_t obj[2], so[2];
+            KernelFn p_open = build(path, opt_level, false, obj[0], so[0]);
+            KernelFn p_closed = build(path, opt_level, true, obj[1], so[1]);
+            if (!p_open || !p_closed)
+            {
+                fprintf(stderr, "Error: cannot build %s\n", path.c_str());
+                return 1;
+            }
+
+            double expect = p_open(prog.arg);
+            double result = p_closed(prog.arg);
+            if (result != expect && !(result != result && expect != expect))
+            {
+                fprintf(stderr, "%s: results differ (%f vs %f)\n", prog.p_name, result, expect);
+                return 1;
+            }
+
+            double ns[2] = { time_kernel(p_open, prog.arg, reps), time_kernel(p_closed, prog.arg, reps) };
+            for (int m = 0; m < 2; ++m)
+            {
+                printf("%-12s %4d %-8s %10zu %10zu %12.1f %8.2f\n",
+                       prog.p_name, opt_level, m ? "whole" : "open",
+                       obj[m], so[m], ns[m], ns[0] / ns[m]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,168 @@
+/*!
+ * @file bench/bench_async.cpp
+ *
+ * @brief This file contains the asynchronous API benchmark.
+ *
+ *          For each of --threads, a fresh JIT and AsyncCompiler compile a
+ *              few definitions with one request. Then one coroutine per
+ *              expression puts all --requests evaluations in flight at
+ *              once from the caller's thread, which only resumes them as
+ *              they complete. It reports the wall time, requests per
+ *              second, p50/p99 latency from request to resumption, and the
+ *              bytes each request holds while in flight.
+ *
+ *          The exit status is non-zero if any result is wrong.
+ *
+ *          Usage: bench_async [--requests N] [--threads LIST]
+ *                             [--compile-threads C] [--opt N]
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "async.hpp"
+#include "alloc_counter.hpp"
+#include "bench_util.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+
+// The definitions the expressions call.
+static const char * program =
+    "extern sin(x);\n"
+    "def f(x) x*x*0.5 + sin(x);\n"
+    "def g(x y) f(x)*y + f(y);\n";
+
+/*!
+ * @brief This function returns what "g(i, 0.5)" should evaluate to.
+ */
+static double
+expected (int i)
+{
+    auto f = [](double x) { return x * x * 0.5 + sin(x); };
+    return f(i) * 0.5 + f(0.5);
+}
+
+/*!
+ * @brief This struct holds what the requests of one run report.
+ */
+struct Tally
+{
+    size_t total = 0;
+    size_t done = 0;
+    size_t wrong = 0;
+    std::vector<double> latency;
+};
+
+static Detached
+setup (AsyncCompiler& compiler, RunLoop& loop, bool& ok)
+{
+    ok = (co_await compiler.compile(program, loop)).ok;
+    loop.stop();
+}
+
+static Detached
+request (AsyncCompiler& compiler, RunLoop& loop, int i, Tally& tally)
+{
+    double start = bench_now();
+    AsyncResult r = co_await compiler.evaluate("g(" + std::to_string(i) + ", 0.5)", loop);
+    tally.latency.push_back(bench_now() - start);
+
+    double want = expected(i);
+    if (!r.ok || fabs(r.value - want) > 1e-12 * fabs(want))
+    {
+        ++tally.wrong;
+    }
+    if (++tally.done == tally.total)
+    {
+        loop.stop();
+    }
+}
+
+int main (int argc, char ** argv)
+{
+    size_t n = strtoull(bench_arg(argc, argv, "--requests", "2048"), nullptr, 10);
+    std::string thread_list = bench_arg(argc, argv, "--threads", "1,2,4");
+    unsigned compile_threads = atoi(bench_arg(argc, argv, "--compile-threads", "2"));
+    g_opt_level = atoi(bench_arg(argc, argv, "--opt", "2"));
+
+    if (!compile_threads || !init_native_target(g_opt_level))
+    {
+        fprintf(stderr, "Error: the JIT needs a compile thread and a target\n");
+        return 1;
+    }
+
+    printf("%8s %9s %10s %10s %10s %12s\n",
+           "threads", "secs", "req/s", "p50 us", "p99 us", "B/in-flight");
+
+    bool failed = false;
+    for (size_t pos = 0; pos < thread_list.size(); )
+    {
+        size_t comma = thread_list.find(',', pos);
+        if (std::string::npos == comma)
+        {
+            comma = thread_list.size();
+        }
+        unsigned threads = atoi(thread_list.substr(pos, comma - pos).c_str());
+        pos = comma + 1;
+
+        if (!init_jit(g_opt_level, false, compile_threads))
+        {
+            return 1;
+        }
+
+        Tally tally;
+        tally.total = n;
+        tally.latency.reserve(n);
+        {
+            AsyncCompiler compiler(threads);
+            RunLoop loop;
+
+            bool ok = false;
+            setup(compiler, loop, ok);
+            loop.run();
+            if (!ok)
+            {
+                fprintf(stderr, "Error: the definitions failed to compile\n");
+                return 1;
+            }
+
+            // The live bytes grow by the coroutine frames and requests;
+            // the few evaluations that start meanwhile add a little noise.
+            double start = bench_now();
+            size_t live = alloc_counts().live;
+            for (size_t i = 0; i < n; ++i)
+            {
+                request(compiler, loop, (int) i, tally);
+            }
+            double per_request = (double) (alloc_counts().live - live) / n;
+
+            loop.run();
+            double secs = bench_now() - start;
+
+            BenchStats st = bench_stats(tally.latency);
+            double p99 = tally.latency[(n - 1) * 99 / 100];
+            printf("%8u %9.3f %10.1f %10.1f %10.1f %12.1f\n",
+                   threads, secs, n / secs, st.median * 1e6, p99 * 1e6, per_request);
+        }
+        g_jit.reset();
+
+        if (tally.wrong)
+        {
+            fprintf(stderr, "Error: %zu of %zu results were wrong\n", tally.wrong, n);
+            failed = true;
+        }
+    }
+
+    if (jit_session_errors())
+    {
+        fprintf(stderr, "Error: the JIT reported %llu errors\n", (unsigned long long) jit_session_errors());
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
+
+/***   end of file   ***/
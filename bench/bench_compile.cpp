@@ -0,0 +1,162 @@
+/*!
+ * @file bench/bench_compile.cpp
+ *
+ * @brief This file contains the end-to-end compile throughput benchmark.
+ *
+ *          Generated programs are run through lex, parse, codegen,
+ *              optimize and emit, and the lines/s and peak RSS of each
+ *              phase are written as JSON. The key order and layout are
+ *              fixed so that runs can be diffed.
+ *
+ *          Usage: bench_compile [--lines N,N,...] [--opt L] [--seed S]
+ *                               [--simplify 0|1] [--fast-math 0|1]
+ *                               [--debug-info 0|1]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "debuginfo.hpp"
+#include "parser.hpp"
+#include "simplify.hpp"
+#include "bench_util.hpp"
+#include "corpus.hpp"
+#include "program.hpp"
+
+/*!
+ * @brief This struct holds the measurements of one phase.
+ */
+struct Phase
+{
+    const char * p_name;
+    double secs;
+    long peak_rss_kb;
+};
+
+/*!
+ * @brief This function lexes the program to EOF.
+ */
+static long
+run_lex (const std::string& text)
+{
+    lexer_set_input(text.data(), text.size());
+
+    long n = 0;
+    while (gettok() != tok_eof)
+    {
+        ++n;
+    }
+
+    return n;
+}
+
+/*!
+ * @brief This function runs one phase, timing it and measuring its peak RSS.
+ */
+template <typename F>
+static bool
+run_phase (std::vector<Phase>& phases, const char * p_name, F fn)
+{
+    bench_reset_peak_rss();
+    double start = bench_now();
+    bool ok = fn();
+    phases.push_back({ p_name, bench_now() - start, bench_peak_rss_kb() });
+
+    if (!ok)
+    {
+        fprintf(stderr, "Error: phase '%s' failed\n", p_name);
+    }
+
+    return ok;
+}
+
+int main (int argc, char ** argv)
+{
+    std::string sizes = bench_arg(argc, argv, "--lines", "1000,100000,10000000");
+    int opt_level = atoi(bench_arg(argc, argv, "--opt", "2"));
+    uint64_t seed = strtoull(bench_arg(argc, argv, "--seed", "1"), nullptr, 10);
+    g_simplify = 0 != atoi(bench_arg(argc, argv, "--simplify", "1"));
+    bool fast_math = 0 != atoi(bench_arg(argc, argv, "--fast-math", "0"));
+    g_debug_info = 0 != atoi(bench_arg(argc, argv, "--debug-info", "0"));
+    if (fast_math)
+    {
+        g_fp_flags.setFast();
+    }
+
+    install_binop_precedence();
+    if (!init_native_target(opt_level))
+    {
+        return 1;
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"compile\",\n");
+    printf("  \"schema\": 3,\n");
+    printf("  \"opt_level\": %d,\n", opt_level);
+    printf("  \"simplify\": %d,\n", g_simplify ? 1 : 0);
+    printf("  \"fast_math\": %d,\n", fast_math ? 1 : 0);
+    printf("  \"debug_info\": %d,\n", g_debug_info ? 1 : 0);
+    printf("  \"seed\": %llu,\n", (unsigned long long) seed);
+    printf("  \"results\": [");
+
+    bool first = true;
+    for (const char * p = sizes.c_str(); *p; )
+    {
+        char * p_end;
+        size_t lines = strtoull(p, &p_end, 10);
+        p = *p_end ? p_end + 1 : p_end;
+
+        fprintf(stderr, "compiling %zu lines...\n", lines);
+        ParseCorpus program = gen_program(lines, seed);
+
+        std::vector<Item> items;
+        llvm::SmallVector<char, 0> object;
+        std::vector<Phase> phases;
+        size_t instructions = 0;
+
+        bool ok = run_phase(phases, "lex", [&] { return run_lex(program.text) > 0; })
+            && run_phase(phases, "parse", [&] { return parse_program(program.text, items); })
+            && run_phase(phases, "codegen", [&] {
+                   init_module("bench");
+                   bool done = codegen_program(items);
+                   instructions = g_module->getInstructionCount();
+                   return done;
+               })
+            && run_phase(phases, "optimize", [&] { optimize_module(*g_module, opt_level); return true; })
+            && run_phase(phases, "emit", [&] { return emit_object(*g_module, object); });
+        if (!ok)
+        {
+            return 1;
+        }
+
+        printf("%s\n    {\n", first ? "" : ",");
+        printf("      \"lines\": %zu,\n", lines);
+        printf("      \"bytes\": %zu,\n", program.text.size());
+        printf("      \"ir_instructions\": %zu,\n", instructions);
+        printf("      \"object_bytes\": %zu,\n", object.size());
+        printf("      \"phases\": {\n");
+        for (size_t i = 0; i < phases.size(); ++i)
+        {
+            printf("        \"%s\": { \"seconds\": %.6f, \"lines_per_sec\": %.1f, \"peak_rss_kb\": %ld }%s\n",
+                   phases[i].p_name, phases[i].secs, lines / phases[i].secs,
+                   phases[i].peak_rss_kb, i + 1 < phases.size() ? "," : "");
+        }
+        printf("      }\n    }");
+        first = false;
+
+        items.clear();
+        g_module.reset();
+        g_function_protos.clear();
+    }
+
+    printf("\n  ]\n}\n");
+
+    lexer_reset();
+    return 0;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,266 @@
+/*!
+ * @file bench/bench_engines.cpp
+ *
+ * @brief This file contains the execution-engine comparison.
+ *
+ *          The same program is run under every engine the driver supports:
+ *              the tree-walking evaluator, the JIT at each optimization
+ *              level, AOT at each level (compiled to a shared object
+ *              through the same emit and link path as an executable, then
+ *              loaded), and the JIT with an out-of-process executor, where
+ *              every call is a round trip to the executor. Each program
+ *              exports "kernel(x)", and each engine reports compile time,
+ *              time to first result and steady-state time per call.
+ *
+ *          The default programs stand for the three workloads: a one-shot
+ *              expression, a repeated formula and a long numeric kernel.
+ *
+ *          Usage: bench_engines [--programs FILE,FILE,...] [--reps R]
+ */
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "bench_util.hpp"
+#include "program.hpp"
+
+typedef double (*KernelFn)(double);
+
+// Keeps the kernel results live.
+static volatile double g_sink;
+
+/*!
+ * @brief This function returns the median time per call in nanoseconds,
+ *          calibrating the number of calls so each sample takes >= 20ms.
+ */
+static double
+time_per_call (const std::function<double(double)>& fn, int reps)
+{
+    long calls = 1;
+    for (;;)
+    {
+        double start = bench_now();
+        for (long i = 0; i < calls; ++i)
+        {
+            g_sink = fn(0.5);
+        }
+        if (bench_now() - start >= 0.02)
+        {
+            break;
+        }
+        calls *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < reps; ++r)
+    {
+        double start = bench_now();
+        for (long i = 0; i < calls; ++i)
+        {
+            g_sink = fn(0.5);
+        }
+        samples.push_back((bench_now() - start) / calls * 1e9);
+    }
+
+    return bench_stats(samples).median;
+}
+
+/*!
+ * @brief This function resets all compiler state between runs.
+ */
+static void
+reset_state (void)
+{
+    g_jit.reset();
+    g_function_protos.clear();
+    g_interp_functions.clear();
+    g_module.reset();
+}
+
+/*!
+ * @brief This function prepares the program for the evaluator.
+ */
+static std::function<double(double)>
+build_interp (const std::string& text)
+{
+    std::vector<Item> items;
+    if (!parse_program(text, items))
+    {
+        return nullptr;
+    }
+
+    for (auto& item : items)
+    {
+        if (item.def)
+        {
+            std::string name = item.def->get_name();
+            g_interp_functions[name] = std::move(item.def);
+        }
+        else if (item.proto)
+        {
+            // Host functions are only called through their extern.
+            std::string name = item.proto->get_name();
+            g_function_protos[name] = std::move(item.proto);
+        }
+    }
+
+    auto it = g_interp_functions.find("kernel");
+    if (it == g_interp_functions.end())
+    {
+        return nullptr;
+    }
+
+    FunctionAST * p_kernel = it->second.get();
+    return [p_kernel](double x) { return p_kernel->evaluate(&x); };
+}
+
+/*!
+ * @brief This function compiles the program with the JIT, running it in
+ *          this process or in an executor process.
+ */
+static std::function<double(double)>
+build_jit (const std::string& text, int opt_level, bool out_of_process)
+{
+    if (!init_jit(opt_level, out_of_process))
+    {
+        return nullptr;
+    }
+    init_module("engines");
+
+    std::vector<Item> items;
+    if (!parse_program(text, items) || !codegen_program(items))
+    {
+        return nullptr;
+    }
+
+    optimize_module(*g_module, opt_level);
+    if (!jit_add_module())
+    {
+        return nullptr;
+    }
+
+    void * p_fn = jit_lookup("kernel");
+    if (!p_fn)
+    {
+        return nullptr;
+    }
+    if (!out_of_process)
+    {
+        return (KernelFn) p_fn;
+    }
+    return [p_fn](double x)
+    {
+        double result = 0.0;
+        jit_call(p_fn, &x, 1, result);
+        return result;
+    };
+}
+
+/*!
+ * @brief This function compiles the program ahead of time and loads it.
+ */
+static std::function<double(double)>
+build_aot (const std::string& text, int opt_level)
+{
+    init_module("engines");
+
+    std::vector<Item> items;
+    if (!parse_program(text, items) || !codegen_program(items))
+    {
+        return nullptr;
+    }
+
+    optimize_module(*g_module, opt_level);
+    llvm::SmallVector<char, 0> object;
+    if (!emit_object(*g_module, object))
+    {
+        return nullptr;
+    }
+
+    static int n_built = 0;
+    std::string so = "/tmp/bench_engines_" + std::to_string(getpid())
+        + "_" + std::to_string(n_built++) + ".so";
+    if (!link_object(object, so, true))
+    {
+        return nullptr;
+    }
+
+    void * p_lib = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+    unlink(so.c_str());
+    KernelFn p_fn = p_lib ? (KernelFn) dlsym(p_lib, "kernel") : nullptr;
+    if (!p_fn)
+    {
+        return nullptr;
+    }
+    return p_fn;
+}
+
+int main (int argc, char ** argv)
+{
+    std::string programs = bench_arg(argc, argv, "--programs",
+        "bench/engines/oneshot.ks,bench/engines/formula.ks,bench/runtime/mandelbrot.ks");
+    int reps = atoi(bench_arg(argc, argv, "--reps", "5"));
+
+    install_binop_precedence();
+
+    printf("%-28s %-8s %12s %12s %14s\n",
+           "program", "engine", "compile us", "first us", "ns/call");
+
+    for (const char * p = programs.c_str(); *p; )
+    {
+        const char * p_end = strchr(p, ',');
+        std::string path = p_end ? std::string(p, p_end) : std::string(p);
+        p = p_end ? p_end + 1 : p + strlen(p);
+
+        std::string text;
+        if (!read_file(path.c_str(), text))
+        {
+            return 1;
+        }
+
+        // Every engine, in order of increasing compile effort.
+        for (int e = -1; e < 12; ++e)
+        {
+            int opt_level = e < 0 ? 0 : e % 4;
+            std::string name = e < 0 ? "interp"
+                : std::string(e < 4 ? "jit-O" : e < 8 ? "aot-O" : "oop-O") + std::to_string(opt_level);
+
+            reset_state();
+            init_native_target(opt_level);
+
+            double start = bench_now();
+            std::function<double(double)> fn = e < 0 ? build_interp(text)
+                : e < 4 ? build_jit(text, opt_level, false)
+                : e < 8 ? build_aot(text, opt_level)
+                : build_jit(text, opt_level, true);
+            double compiled = bench_now();
+            if (!fn)
+            {
+                fprintf(stderr, "Error: %s failed to build %s\n", name.c_str(), path.c_str());
+                return 1;
+            }
+
+            g_sink = fn(0.5);
+            double first = bench_now();
+
+            printf("%-28s %-8s %12.1f %12.1f %14.1f\n",
+                   path.c_str(), name.c_str(),
+                   (compiled - start) * 1e6, (first - start) * 1e6,
+                   time_per_call(fn, reps));
+        }
+    }
+
+    reset_state();
+
+    return 0;
+}
+
+/***   end of file   ***/
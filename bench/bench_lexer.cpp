@@ -0,0 +1,88 @@
+/*!
+ * @file bench/bench_lexer.cpp
+ *
+ * @brief This file contains the lexer microbenchmark.
+ *
+ *          Each corpus is generated in memory and fed through gettok()
+ *              repeatedly, reporting throughput in MB/s and tokens/s.
+ *
+ *          Usage: bench_lexer [--size BYTES] [--reps N] [--seed S]
+ *                             [--corpus NAME]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "lexer.hpp"
+#include "bench_util.hpp"
+#include "corpus.hpp"
+
+// Prevents the token loop from being optimized away.
+static volatile long g_sink;
+
+/*!
+ * @brief This function lexes the buffer to EOF once.
+ *
+ * @return The number of tokens produced.
+ */
+static long
+lex_all (const std::string& corpus)
+{
+    lexer_set_input(corpus.data(), corpus.size());
+
+    long n = 0;
+    while (gettok() != tok_eof)
+    {
+        ++n;
+    }
+
+    return n;
+}
+
+int main (int argc, char ** argv)
+{
+    size_t size = strtoull(bench_arg(argc, argv, "--size", "16777216"), nullptr, 10);
+    int reps = atoi(bench_arg(argc, argv, "--reps", "10"));
+    uint64_t seed = strtoull(bench_arg(argc, argv, "--seed", "1"), nullptr, 10);
+    const char * p_only = bench_arg(argc, argv, "--corpus", nullptr);
+
+    printf("%-12s %10s %10s %8s %12s %8s\n",
+           "corpus", "bytes", "MB/s", "+/-", "Mtok/s", "+/-");
+
+    for (int k = lex_identifiers; k <= lex_mixed; ++k)
+    {
+        LexCorpus kind = (LexCorpus) k;
+        if (p_only && 0 != strcmp(p_only, lex_corpus_name(kind)))
+        {
+            continue;
+        }
+
+        std::string corpus = gen_lex_corpus(kind, size, seed);
+
+        // Warm up caches and the allocator.
+        long tokens = lex_all(corpus);
+
+        std::vector<double> mbps;
+        std::vector<double> mtps;
+        for (int r = 0; r < reps; ++r)
+        {
+            double start = bench_now();
+            g_sink = lex_all(corpus);
+            double secs = bench_now() - start;
+
+            mbps.push_back(corpus.size() / secs / 1e6);
+            mtps.push_back(tokens / secs / 1e6);
+        }
+
+        BenchStats b = bench_stats(mbps);
+        BenchStats t = bench_stats(mtps);
+        printf("%-12s %10zu %10.1f %8.1f %12.2f %8.2f\n",
+               lex_corpus_name(kind), corpus.size(),
+               b.mean, b.stddev, t.mean, t.stddev);
+    }
+
+    lexer_reset();
+    return 0;
+}
+
+/***   end of file   ***/
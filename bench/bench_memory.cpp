@@ -0,0 +1,213 @@
+/*!
+ * @file bench/bench_memory.cpp
+ *
+ * @brief This file contains the peak memory regression benchmark.
+ *
+ *          Generated programs are compiled (parse, codegen, optimize,
+ *              emit) at several sizes, recording peak RSS, the total volume
+ *              and number of allocations, and the bytes still held per
+ *              top-level item after parsing (the AST) and after codegen
+ *              (the IR). Results are printed as JSON, one result per line.
+ *
+ *          With --baseline, every metric is compared against the result of
+ *              the same size in a stored run, and the exit status is
+ *              non-zero if any grew by more than --threshold percent.
+ *              Refresh the baseline by redirecting a run into the file.
+ *
+ *          Usage: bench_memory [--lines N,N,...] [--opt L] [--seed S]
+ *                              [--baseline FILE] [--threshold PCT]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "alloc_counter.hpp"
+#include "bench_util.hpp"
+#include "corpus.hpp"
+#include "program.hpp"
+
+/*!
+ * @brief This struct holds the measurements of one size.
+ */
+struct MemResult
+{
+    size_t lines = 0;
+    double metrics[5] = {};
+};
+
+// The metrics in output order. Larger is worse for all of them.
+static const char * metric_names[] = {
+    "peak_rss_kb", "alloc_bytes", "alloc_count", "ast_bytes_per_item", "ir_bytes_per_item",
+};
+static const int n_metrics = 5;
+
+/*!
+ * @brief This function compiles a program of the given size and measures it.
+ */
+static bool
+measure (size_t lines, int opt_level, uint64_t seed, MemResult& r)
+{
+    ParseCorpus program = gen_program(lines, seed);
+    r.lines = lines;
+
+    bench_reset_peak_rss();
+    AllocCounts start = alloc_counts();
+
+    std::vector<Item> items;
+    if (!parse_program(program.text, items))
+    {
+        return false;
+    }
+    AllocCounts parsed = alloc_counts();
+
+    init_module("memory");
+    AllocCounts module_start = alloc_counts();
+    if (!codegen_program(items))
+    {
+        return false;
+    }
+    AllocCounts generated = alloc_counts();
+
+    llvm::SmallVector<char, 0> object;
+    optimize_module(*g_module, opt_level);
+    if (!emit_object(*g_module, object))
+    {
+        return false;
+    }
+    AllocCounts end = alloc_counts();
+
+    r.metrics[0] = bench_peak_rss_kb();
+    r.metrics[1] = end.bytes - start.bytes;
+    r.metrics[2] = end.count - start.count;
+    r.metrics[3] = ((double) parsed.live - start.live) / items.size();
+    r.metrics[4] = ((double) generated.live - module_start.live) / items.size();
+
+    items.clear();
+    g_module.reset();
+    g_function_protos.clear();
+    return true;
+}
+
+/*!
+ * @brief This function loads the results of a stored run.
+ */
+static std::vector<MemResult>
+load_baseline (const char * p_path)
+{
+    std::vector<MemResult> out;
+    FILE * p_file = fopen(p_path, "r");
+    if (!p_file)
+    {
+        fprintf(stderr, "Error: cannot open baseline %s\n", p_path);
+        return out;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), p_file))
+    {
+        const char * p = strstr(line, "\"lines\":");
+        if (!p)
+        {
+            continue;
+        }
+
+        MemResult r;
+        r.lines = strtoull(p + 8, nullptr, 10);
+        for (int m = 0; m < n_metrics; ++m)
+        {
+            std::string key = std::string("\"") + metric_names[m] + "\":";
+            p = strstr(line, key.c_str());
+            r.metrics[m] = p ? strtod(p + key.size(), nullptr) : 0.0;
+        }
+        out.push_back(r);
+    }
+
+    fclose(p_file);
+    return out;
+}
+
+int main (int argc, char ** argv)
+{
+    std::string sizes = bench_arg(argc, argv, "--lines", "1000,10000,100000");
+    int opt_level = atoi(bench_arg(argc, argv, "--opt", "2"));
+    uint64_t seed = strtoull(bench_arg(argc, argv, "--seed", "1"), nullptr, 10);
+    const char * p_baseline = bench_arg(argc, argv, "--baseline", nullptr);
+    double threshold = atof(bench_arg(argc, argv, "--threshold", "10"));
+
+    install_binop_precedence();
+    if (!init_native_target(opt_level))
+    {
+        return 1;
+    }
+
+    std::vector<MemResult> baseline;
+    if (p_baseline)
+    {
+        baseline = load_baseline(p_baseline);
+        if (baseline.empty())
+        {
+            return 1;
+        }
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"memory\",\n");
+    printf("  \"schema\": 1,\n");
+    printf("  \"opt_level\": %d,\n", opt_level);
+    printf("  \"seed\": %llu,\n", (unsigned long long) seed);
+    printf("  \"results\": [\n");
+
+    int regressions = 0;
+    bool first = true;
+    for (const char * p = sizes.c_str(); *p; )
+    {
+        char * p_end;
+        size_t lines = strtoull(p, &p_end, 10);
+        p = *p_end ? p_end + 1 : p_end;
+
+        MemResult r;
+        if (!measure(lines, opt_level, seed, r))
+        {
+            fprintf(stderr, "Error: compiling %zu lines failed\n", lines);
+            return 1;
+        }
+
+        printf("%s    { \"lines\": %zu", first ? "" : ",\n", r.lines);
+        for (int m = 0; m < n_metrics; ++m)
+        {
+            printf(", \"%s\": %.0f", metric_names[m], r.metrics[m]);
+        }
+        printf(" }");
+        first = false;
+
+        // Compare against the stored run of the same size, if any.
+        for (const auto& b : baseline)
+        {
+            if (b.lines != r.lines)
+            {
+                continue;
+            }
+
+            for (int m = 0; m < n_metrics; ++m)
+            {
+                double limit = b.metrics[m] * (1.0 + threshold / 100.0);
+                if (r.metrics[m] > limit)
+                {
+                    fprintf(stderr, "REGRESSION lines=%zu %s: %.0f > %.0f (baseline %.0f +%.0f%%)\n",
+                            r.lines, metric_names[m], r.metrics[m], limit, b.metrics[m], threshold);
+                    ++regressions;
+                }
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+
+    lexer_reset();
+    return regressions ? 1 : 0;
+}
+
+/***   end of file   ***/
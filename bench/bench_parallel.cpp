@@ -0,0 +1,126 @@
+/*!
+ * @file bench/bench_parallel.cpp
+ *
+ * @brief This file contains the parallel compile scalability benchmark.
+ *
+ *          A generated corpus of independent files is compiled with
+ *              compile_files() at 1, 2, 4, ... --max-jobs threads, reporting
+ *              speedup over one thread, parallel efficiency and the time
+ *              workers spent waiting on the work queue. Every run's objects
+ *              are compared with the single-threaded ones, and the exit
+ *              status is non-zero if any differ by a single byte.
+ *
+ *          Usage: bench_parallel [--files K] [--lines L] [--max-jobs N]
+ *                                [--runs R] [--opt L] [--seed S]
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.hpp"
+#include "compiler.hpp"
+#include "bench_util.hpp"
+#include "corpus.hpp"
+
+int main (int argc, char ** argv)
+{
+    unsigned n_files = atoi(bench_arg(argc, argv, "--files", "32"));
+    size_t lines = strtoull(bench_arg(argc, argv, "--lines", "2000"), nullptr, 10);
+    unsigned hw = std::thread::hardware_concurrency();
+    unsigned max_jobs = atoi(bench_arg(argc, argv, "--max-jobs", std::to_string(hw ? hw : 1).c_str()));
+    int runs = atoi(bench_arg(argc, argv, "--runs", "3"));
+    uint64_t seed = strtoull(bench_arg(argc, argv, "--seed", "1"), nullptr, 10);
+    g_opt_level = atoi(bench_arg(argc, argv, "--opt", "2"));
+
+    // Write the corpus, one seed per file.
+    char dir[] = "/tmp/bench_parallel_XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        fprintf(stderr, "Error: cannot create a temporary directory\n");
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    for (unsigned i = 0; i < n_files; ++i)
+    {
+        std::string path = std::string(dir) + "/unit" + std::to_string(i) + ".ks";
+        ParseCorpus program = gen_program(lines, seed + i);
+        FILE * p_file = fopen(path.c_str(), "wb");
+        if (!p_file)
+        {
+            fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+            return 1;
+        }
+        fwrite(program.text.data(), 1, program.text.size(), p_file);
+        fclose(p_file);
+        paths.push_back(path);
+    }
+
+    printf("%5s %10s %9s %11s %14s %12s\n",
+           "jobs", "wall s", "speedup", "efficiency", "queue wait ms", "identical");
+
+    std::vector<llvm::SmallVector<char, 0>> reference;
+    double base_wall = 0.0;
+    int mismatches = 0;
+    for (unsigned jobs = 1; jobs <= max_jobs; jobs = jobs < max_jobs && jobs * 2 > max_jobs ? max_jobs : jobs * 2)
+    {
+        std::vector<double> walls;
+        double wait = 0.0;
+        bool identical = true;
+        for (int r = 0; r < runs; ++r)
+        {
+            BatchStats stats;
+            std::vector<llvm::SmallVector<char, 0>> objects;
+            if (!compile_files(paths, jobs, stats, &objects))
+            {
+                return 1;
+            }
+            walls.push_back(stats.wall);
+            wait += stats.queue_wait / runs;
+
+            if (reference.empty())
+            {
+                reference = std::move(objects);
+                continue;
+            }
+            for (size_t i = 0; i < objects.size(); ++i)
+            {
+                if (objects[i] != reference[i])
+                {
+                    fprintf(stderr, "MISMATCH jobs=%u run=%d %s\n", jobs, r, paths[i].c_str());
+                    identical = false;
+                    ++mismatches;
+                }
+            }
+        }
+
+        double wall = bench_stats(walls).median;
+        if (1 == jobs)
+        {
+            base_wall = wall;
+        }
+        printf("%5u %10.3f %9.2f %10.0f%% %14.2f %12s\n",
+               jobs, wall, base_wall / wall, 100.0 * base_wall / wall / jobs,
+               wait * 1e3, identical ? "yes" : "NO");
+
+        if (jobs == max_jobs)
+        {
+            break;
+        }
+    }
+
+    for (const auto& path : paths)
+    {
+        unlink(path.c_str());
+    }
+    rmdir(dir);
+
+    return mismatches ? 1 : 0;
+}
+
+/***   end of file   ***/
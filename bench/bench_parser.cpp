@@ -0,0 +1,143 @@
+/*!
+ * @file bench/bench_parser.cpp
+ *
+ * @brief This file contains the parser benchmark.
+ *
+ *          Each AST shape is generated at several sizes and parsed with
+ *              parse_definition() / parse_expression(), reporting nodes/s
+ *              and allocation volume per node. The time per node should
+ *              stay flat as the size doubles; growth means the parser has
+ *              gone super-linear for that shape.
+ *
+ *          Usage: bench_parser [--n N] [--steps K] [--reps R] [--seed S]
+ *                              [--shape NAME]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "parser.hpp"
+#include "alloc_counter.hpp"
+#include "bench_util.hpp"
+#include "corpus.hpp"
+
+/*!
+ * @brief This function parses every top-level item in the corpus.
+ *
+ * @param asts Receives the parsed items so that they are freed outside the
+ *              timed region.
+ *
+ * @return The number of items parsed successfully.
+ */
+static size_t
+parse_all (const std::string& text,
+           std::vector<std::unique_ptr<FunctionAST>>& defs,
+           std::vector<std::unique_ptr<ExprAST>>& exprs)
+{
+    lexer_set_input(text.data(), text.size());
+    get_next_token();
+
+    size_t n = 0;
+    while (cur_tok != tok_eof)
+    {
+        if (';' == cur_tok)
+        {
+            get_next_token();
+            continue;
+        }
+
+        if (tok_def == cur_tok)
+        {
+            auto def = parse_definition();
+            if (!def)
+            {
+                break;
+            }
+            defs.push_back(std::move(def));
+        }
+        else
+        {
+            auto expr = parse_expression();
+            if (!expr)
+            {
+                break;
+            }
+            exprs.push_back(std::move(expr));
+        }
+        ++n;
+    }
+
+    return n;
+}
+
+int main (int argc, char ** argv)
+{
+    size_t base_n = strtoull(bench_arg(argc, argv, "--n", "4096"), nullptr, 10);
+    int steps = atoi(bench_arg(argc, argv, "--steps", "4"));
+    int reps = atoi(bench_arg(argc, argv, "--reps", "5"));
+    uint64_t seed = strtoull(bench_arg(argc, argv, "--seed", "1"), nullptr, 10);
+    const char * p_only = bench_arg(argc, argv, "--shape", nullptr);
+
+    install_binop_precedence();
+
+    // The deep shapes are meant to measure, not to hit the depth guard.
+    max_parse_depth = ~0u;
+
+    printf("%-14s %9s %10s %9s %10s %8s %10s %10s\n",
+           "shape", "n", "bytes", "nodes", "Mnodes/s", "+/-", "ns/node", "B/node");
+
+    for (int s = shape_small_defs; s <= shape_wide_call; ++s)
+    {
+        ParseShape shape = (ParseShape) s;
+        if (p_only && 0 != strcmp(p_only, parse_shape_name(shape)))
+        {
+            continue;
+        }
+
+        size_t n = base_n;
+        for (int step = 0; step < steps; ++step, n *= 2)
+        {
+            ParseCorpus c = gen_parse_corpus(shape, n, seed);
+
+            std::vector<double> rates;
+            AllocCounts alloc_delta;
+            for (int r = 0; r < reps; ++r)
+            {
+                std::vector<std::unique_ptr<FunctionAST>> defs;
+                std::vector<std::unique_ptr<ExprAST>> exprs;
+                defs.reserve(c.items);
+                exprs.reserve(c.items);
+
+                AllocCounts before = alloc_counts();
+                double start = bench_now();
+                size_t items = parse_all(c.text, defs, exprs);
+                double secs = bench_now() - start;
+                AllocCounts after = alloc_counts();
+
+                if (items != c.items)
+                {
+                    fprintf(stderr, "%s: parsed %zu of %zu items\n",
+                            parse_shape_name(shape), items, c.items);
+                    return 1;
+                }
+
+                alloc_delta.bytes = after.bytes - before.bytes;
+                alloc_delta.count = after.count - before.count;
+                rates.push_back(c.nodes / secs / 1e6);
+            }
+
+            BenchStats st = bench_stats(rates);
+            printf("%-14s %9zu %10zu %9zu %10.2f %8.2f %10.1f %10.1f\n",
+                   parse_shape_name(shape), n, c.text.size(), c.nodes,
+                   st.mean, st.stddev, 1e3 / st.mean,
+                   (double) alloc_delta.bytes / c.nodes);
+        }
+    }
+
+    lexer_reset();
+    return 0;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,269 @@
+/*!
+ * @file bench/bench_repl.cpp
+ *
+ * @brief This file contains the REPL latency harness.
+ *
+ *          A recorded session is replayed through parse(), the same loop
+ *              that serves interactive input, and the latency of every item
+ *              is recorded per phase, from the end of the previous item to
+ *              its result. p50/p90/p99/max are reported per phase for:
+ *
+ *              cold: each item of --cold-runs freshly exec'd processes,
+ *                    plus the time from exec to the first prompt;
+ *              warm: --warm-passes replays in one process after a
+ *                    discarded warmup pass, each on a fresh JIT.
+ *
+ *          With --speculate N the JIT compiles on N background threads
+ *              and speculates on callees; bench/repl/chain.ks is the session
+ *              that shows the effect on time to first result.
+ *
+ *          Usage: bench_repl [--input bench/repl/session.ks] [--opt L]
+ *                            [--cold-runs R] [--warm-passes P]
+ *                            [--speculate N]
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "bench_util.hpp"
+#include "program.hpp"
+
+static const char * phase_names[] = { "parse", "codegen", "optimize", "jit", "execute", "total" };
+static const int n_phases = 6;
+
+// The timings of the items in the current pass.
+static std::vector<ItemTiming> g_timings;
+
+/*!
+ * @brief This function records each item parse() handles.
+ */
+static void
+record_item (const ItemTiming& timing)
+{
+    g_timings.push_back(timing);
+}
+
+/*!
+ * @brief This function replays the session in this process and writes one
+ *          line of phase times per item to out, for every pass after the
+ *          first `skip`.
+ */
+static int
+run_child (const std::string& text, int opt_level, unsigned threads,
+           int passes, int skip, FILE * p_out)
+{
+    double start = bench_now();
+    if (!init_native_target(opt_level))
+    {
+        return 1;
+    }
+    g_opt_level = opt_level;
+    p_item_observer = record_item;
+
+    // The REPL's own chatter would dominate the report.
+    freopen("/dev/null", "w", stderr);
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        // A fresh JIT each pass, as the session redefines the same names.
+        g_jit.reset();
+        g_function_protos.clear();
+        if (!init_jit(opt_level, false, threads))
+        {
+            return 1;
+        }
+        init_module("repl");
+
+        if (0 == pass)
+        {
+            fprintf(p_out, "startup %.9f\n", bench_now() - start);
+        }
+
+        g_timings.clear();
+        lexer_set_input(text.data(), text.size());
+        parse();
+
+        if (pass < skip)
+        {
+            continue;
+        }
+        for (const auto& t : g_timings)
+        {
+            fprintf(p_out, "item %d %d %.9f %.9f %.9f %.9f %.9f\n",
+                    t.kind, t.ok, t.parse, t.codegen, t.optimize, t.jit, t.execute);
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * @brief This struct holds the samples of one run mode, per phase.
+ */
+struct Samples
+{
+    std::vector<double> phase[n_phases];
+    std::vector<double> startup;
+    size_t failed = 0;
+};
+
+/*!
+ * @brief This function runs a fresh copy of this program as a child and
+ *          collects what it reports.
+ */
+static bool
+spawn_child (char * p_self, const char * p_input, const char * p_opt, const char * p_threads,
+             const char * p_passes, const char * p_skip, Samples& samples)
+{
+    int fds[2];
+    if (pipe(fds))
+    {
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(p_self, p_self, "--child", "--input", p_input, "--opt", p_opt,
+              "--speculate", p_threads, "--passes", p_passes, "--skip", p_skip,
+              (char *) nullptr);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    FILE * p_in = fdopen(fds[0], "r");
+    char line[512];
+    while (fgets(line, sizeof(line), p_in))
+    {
+        double v[5];
+        int kind, ok;
+        if (1 == sscanf(line, "startup %lf", &v[0]))
+        {
+            samples.startup.push_back(v[0]);
+        }
+        else if (7 == sscanf(line, "item %d %d %lf %lf %lf %lf %lf",
+                             &kind, &ok, &v[0], &v[1], &v[2], &v[3], &v[4]))
+        {
+            if (!ok)
+            {
+                ++samples.failed;
+            }
+
+            double total = 0.0;
+            for (int p = 0; p < 5; ++p)
+            {
+                samples.phase[p].push_back(v[p]);
+                total += v[p];
+            }
+            samples.phase[5].push_back(total);
+        }
+    }
+    fclose(p_in);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && 0 == WEXITSTATUS(status);
+}
+
+/*!
+ * @brief This function returns the nearest-rank percentile of sorted data.
+ */
+static double
+percentile (const std::vector<double>& sorted, double pct)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+
+    size_t rank = (size_t) (pct / 100.0 * sorted.size() + 0.999999);
+    rank = rank < 1 ? 1 : rank > sorted.size() ? sorted.size() : rank;
+    return sorted[rank - 1];
+}
+
+/*!
+ * @brief This function prints one row of percentiles, in microseconds.
+ */
+static void
+print_row (const char * p_mode, const char * p_phase, std::vector<double> data)
+{
+    std::sort(data.begin(), data.end());
+    printf("%-5s %-9s %7zu %10.1f %10.1f %10.1f %10.1f\n",
+           p_mode, p_phase, data.size(),
+           percentile(data, 50) * 1e6, percentile(data, 90) * 1e6,
+           percentile(data, 99) * 1e6, data.empty() ? 0.0 : data.back() * 1e6);
+}
+
+int main (int argc, char ** argv)
+{
+    const char * p_input = bench_arg(argc, argv, "--input", "bench/repl/session.ks");
+    const char * p_opt = bench_arg(argc, argv, "--opt", "2");
+    int cold_runs = atoi(bench_arg(argc, argv, "--cold-runs", "20"));
+    const char * p_passes = bench_arg(argc, argv, "--warm-passes", "20");
+    const char * p_threads = bench_arg(argc, argv, "--speculate", "0");
+
+    std::string text;
+    if (!read_file(p_input, text))
+    {
+        return 1;
+    }
+
+    if (bench_flag(argc, argv, "--child"))
+    {
+        return run_child(text, atoi(p_opt), atoi(p_threads),
+                         atoi(bench_arg(argc, argv, "--passes", "1")),
+                         atoi(bench_arg(argc, argv, "--skip", "0")), stdout);
+    }
+
+    // Each cold run is a freshly exec'd process replaying the session once.
+    Samples cold;
+    for (int r = 0; r < cold_runs; ++r)
+    {
+        if (!spawn_child(argv[0], p_input, p_opt, p_threads, "1", "0", cold))
+        {
+            fprintf(stderr, "Error: cold run %d failed\n", r);
+            return 1;
+        }
+    }
+
+    // The warm run replays it repeatedly in one process, after a warmup.
+    Samples warm;
+    std::string passes = std::to_string(atoi(p_passes) + 1);
+    if (!spawn_child(argv[0], p_input, p_opt, p_threads, passes.c_str(), "1", warm))
+    {
+        fprintf(stderr, "Error: warm run failed\n");
+        return 1;
+    }
+
+    printf("%-5s %-9s %7s %10s %10s %10s %10s   (us)\n",
+           "mode", "phase", "items", "p50", "p90", "p99", "max");
+    print_row("cold", "startup", cold.startup);
+    for (int p = 0; p < n_phases; ++p)
+    {
+        print_row("cold", phase_names[p], cold.phase[p]);
+    }
+    for (int p = 0; p < n_phases; ++p)
+    {
+        print_row("warm", phase_names[p], warm.phase[p]);
+    }
+
+    if (cold.failed || warm.failed)
+    {
+        fprintf(stderr, "warning: %zu cold and %zu warm items failed to compile\n",
+                cold.failed, warm.failed);
+    }
+
+    return 0;
+}
+
+/***   end of file   ***/
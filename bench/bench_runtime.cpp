@@ -0,0 +1,259 @@
+/*!
+ * @file bench/bench_runtime.cpp
+ *
+ * @brief This file contains the generated-code performance suite.
+ *
+ *          Each program in bench/runtime exports "kernel(x)" from both its
+ *              Kaleidoscope source and its C reference. The Kaleidoscope
+ *              version is JIT'd at each optimization level, the C version
+ *              is built as a shared object by $CC (clang by default) at
+ *              the same level, and the time per call of each is compared.
+ *              A ratio above 1 means the generated code is slower than C.
+ *
+ *          --fp takes a comma separated list of the floating point
+ *              relaxations to allow, contract, reassoc or fast, and
+ *              passes the matching flags to $CC.
+ *
+ *          Usage: bench_runtime [--dir bench/runtime] [--levels 0,1,2,3]
+ *                               [--program NAME] [--reps R] [--fp LIST]
+ */
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "bench_util.hpp"
+#include "program.hpp"
+
+// The suite, and the argument each kernel is called with.
+static const struct
+{
+    const char * p_name;
+    double arg;
+} programs[] = {
+    { "fib", 1.0 },
+    { "newton", 3.0 },
+    { "integrate", 2.0 },
+    { "mandelbrot", -1.0 },
+    { "poly", 0.5 },
+    { "deviation", 3.0 },
+};
+
+// The floating point relaxations, and the C compiler flags that match them.
+static const struct
+{
+    const char * p_name;
+    const char * p_cflags;
+    void (*p_allow)(llvm::FastMathFlags& flags);
+} fp_modes[] = {
+    { "contract", " -ffp-contract=fast", [] (llvm::FastMathFlags& f) { f.setAllowContract(); } },
+    { "reassoc", " -fassociative-math -fno-signed-zeros -fno-trapping-math",
+      [] (llvm::FastMathFlags& f) { f.setAllowReassoc(); } },
+    { "fast", " -ffast-math", [] (llvm::FastMathFlags& f) { f.setFast(); } },
+};
+
+typedef double (*KernelFn)(double);
+
+// Keeps the kernel results live.
+static volatile double g_sink;
+
+/*!
+ * @brief This function times a kernel, calibrating the number of calls so
+ *          that each sample takes at least 50ms.
+ *
+ * @return The median time per call in nanoseconds.
+ */
+static double
+time_kernel (KernelFn p_fn, double arg, int reps)
+{
+    long calls = 1;
+    for (;;)
+    {
+        double start = bench_now();
+        for (long i = 0; i < calls; ++i)
+        {
+            g_sink = p_fn(arg);
+        }
+        if (bench_now() - start >= 0.05)
+        {
+            break;
+        }
+        calls *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < reps; ++r)
+    {
+        double start = bench_now();
+        for (long i = 0; i < calls; ++i)
+        {
+            g_sink = p_fn(arg);
+        }
+        samples.push_back((bench_now() - start) / calls * 1e9);
+    }
+
+    return bench_stats(samples).median;
+}
+
+/*!
+ * @brief This function JIT-compiles a Kaleidoscope program at a level.
+ *
+ * @return The kernel, or nullptr on error.
+ */
+static KernelFn
+build_kaleidoscope (const std::string& path, int opt_level)
+{
+    std::string text;
+    if (!read_file(path.c_str(), text))
+    {
+        return nullptr;
+    }
+
+    // Start from a fresh JIT so levels don't share compiled code.
+    g_jit.reset();
+    g_function_protos.clear();
+    g_opt_level = opt_level;
+    if (!init_native_target(opt_level) || !init_jit(opt_level))
+    {
+        return nullptr;
+    }
+    init_module(path);
+
+    std::vector<Item> items;
+    if (!parse_program(text, items) || !codegen_program(items))
+    {
+        return nullptr;
+    }
+
+    optimize_module(*g_module, opt_level);
+    if (!jit_add_module())
+    {
+        return nullptr;
+    }
+
+    return (KernelFn) jit_lookup("kernel");
+}
+
+/*!
+ * @brief This function builds and loads a C reference at a level.
+ *
+ * @return The kernel, or nullptr on error.
+ */
+static KernelFn
+build_c (const char * p_cc, const std::string& path, int opt_level, const std::string& cflags)
+{
+    static int n_built = 0;
+    std::string so = "/tmp/bench_runtime_" + std::to_string(getpid())
+        + "_" + std::to_string(n_built++) + ".so";
+
+    // Exported functions must stay inlinable, as they are in the JIT.
+    std::string cmd = std::string(p_cc) + " -O" + std::to_string(opt_level) + cflags
+        + " -shared -fPIC -fno-semantic-interposition -o " + so + " " + path + " -lm";
+    if (0 != system(cmd.c_str()))
+    {
+        fprintf(stderr, "Error: '%s' failed\n", cmd.c_str());
+        return nullptr;
+    }
+
+    void * p_lib = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+    unlink(so.c_str());
+    if (!p_lib)
+    {
+        fprintf(stderr, "Error: %s\n", dlerror());
+        return nullptr;
+    }
+
+    return (KernelFn) dlsym(p_lib, "kernel");
+}
+
+int main (int argc, char ** argv)
+{
+    std::string dir = bench_arg(argc, argv, "--dir", "bench/runtime");
+    std::string levels = bench_arg(argc, argv, "--levels", "0,1,2,3");
+    const char * p_only = bench_arg(argc, argv, "--program", nullptr);
+    int reps = atoi(bench_arg(argc, argv, "--reps", "5"));
+    std::string fp = bench_arg(argc, argv, "--fp", "");
+
+    std::string cflags;
+    for (const char * p = fp.c_str(); *p; )
+    {
+        const char * p_end = strchr(p, ',');
+        std::string name(p, p_end ? p_end - p : strlen(p));
+        p = p_end ? p_end + 1 : p + name.size();
+
+        bool known = false;
+        for (const auto& mode : fp_modes)
+        {
+            if (name == mode.p_name)
+            {
+                cflags += mode.p_cflags;
+                mode.p_allow(g_fp_flags);
+                known = true;
+            }
+        }
+        if (!known)
+        {
+            fprintf(stderr, "Error: unknown --fp mode '%s'\n", name.c_str());
+            return 1;
+        }
+    }
+
+    // Prefer clang, as the JIT is LLVM too.
+    const char * p_cc = getenv("CC");
+    if (!p_cc)
+    {
+        p_cc = 0 == system("command -v clang >/dev/null 2>&1") ? "clang" : "cc";
+    }
+
+    install_binop_precedence();
+
+    printf("%-12s %5s %14s %14s %9s %14s\n",
+           "program", "opt", "kaleido ns", "C ns", "slowdown", "result");
+
+    for (const auto& prog : programs)
+    {
+        if (p_only && 0 != strcmp(p_only, prog.p_name))
+        {
+            continue;
+        }
+
+        for (const char * p = levels.c_str(); *p; )
+        {
+            char * p_end;
+            int opt_level = (int) strtol(p, &p_end, 10);
+            p = *p_end ? p_end + 1 : p_end;
+
+            KernelFn p_ks = build_kaleidoscope(dir + "/" + prog.p_name + ".ks", opt_level);
+            KernelFn p_c = build_c(p_cc, dir + "/" + prog.p_name + ".c", opt_level, cflags);
+            if (!p_ks || !p_c)
+            {
+                return 1;
+            }
+
+            // Both must compute the same thing for the ratio to mean much.
+            double result = p_ks(prog.arg);
+            if (result != p_c(prog.arg) && !(result != result))
+            {
+                fprintf(stderr, "%s: results differ (%f vs %f)\n",
+                        prog.p_name, result, p_c(prog.arg));
+            }
+
+            double ks_ns = time_kernel(p_ks, prog.arg, reps);
+            double c_ns = time_kernel(p_c, prog.arg, reps);
+            printf("%-12s %5s %14.1f %14.1f %9.2f %14.6g\n",
+                   prog.p_name, ("-O" + std::to_string(opt_level)).c_str(),
+                   ks_ns, c_ns, ks_ns / c_ns, result);
+        }
+    }
+
+    return 0;
+}
+
+/***   end of file   ***/
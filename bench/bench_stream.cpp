@@ -0,0 +1,144 @@
+/*!
+ * @file bench/bench_stream.cpp
+ *
+ * @brief This file contains the resumable parser benchmark.
+ *
+ *          One thread serves --sessions inputs at once, each a copy of the
+ *              same generated program. Round robin, every session is fed a
+ *              chunk of 1 to --max-chunk bytes, cut anywhere, and then
+ *              parses whatever items the chunk completed. The throughput
+ *              is compared with parsing the program whole, and the bytes
+ *              each session holds between chunks are reported.
+ *
+ *          The exit status is non-zero if any session parses a different
+ *              number of items than the whole program has.
+ *
+ *          Usage: bench_stream [--sessions N] [--lines L] [--max-chunk B]
+ *                              [--seed S]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "stream.hpp"
+#include "bench_util.hpp"
+#include "corpus.hpp"
+#include "program.hpp"
+
+/*!
+ * @brief This struct holds one session and how far its input has been fed.
+ */
+struct Session
+{
+    StreamParser parser;
+    size_t fed = 0;
+    size_t items = 0;
+    size_t errors = 0;
+    bool done = false;
+};
+
+int main (int argc, char ** argv)
+{
+    size_t n_sessions = strtoull(bench_arg(argc, argv, "--sessions", "4096"), nullptr, 10);
+    size_t lines = strtoull(bench_arg(argc, argv, "--lines", "200"), nullptr, 10);
+    uint32_t max_chunk = strtoul(bench_arg(argc, argv, "--max-chunk", "64"), nullptr, 10);
+    uint64_t seed = strtoull(bench_arg(argc, argv, "--seed", "1"), nullptr, 10);
+
+    install_binop_precedence();
+
+    ParseCorpus c = gen_program(lines, seed);
+
+    // The baseline: the same bytes, parsed whole.
+    double start = bench_now();
+    for (size_t i = 0; i < n_sessions; ++i)
+    {
+        std::vector<Item> items;
+        if (!parse_program(c.text, items) || items.size() != c.items)
+        {
+            fprintf(stderr, "Error: the program does not parse whole\n");
+            return 1;
+        }
+    }
+    double whole_secs = bench_now() - start;
+
+    bench_reset_peak_rss();
+    long base_kb = bench_peak_rss_kb();
+
+    std::vector<Session> sessions(n_sessions);
+    CorpusRng rng(seed);
+    size_t chunks = 0;
+    size_t live = n_sessions;
+    size_t peak_held = 0;
+
+    start = bench_now();
+    while (live)
+    {
+        size_t held = 0;
+        for (auto& s : sessions)
+        {
+            if (s.done)
+            {
+                continue;
+            }
+
+            size_t len = std::min<size_t>(1 + rng.below(max_chunk), c.text.size() - s.fed);
+            s.parser.feed(c.text.data() + s.fed, len);
+            s.fed += len;
+            ++chunks;
+            if (s.fed == c.text.size())
+            {
+                s.parser.finish();
+            }
+
+            StreamItem item;
+            StreamStatus status;
+            while (stream_need_more != (status = s.parser.next(item)))
+            {
+                if (stream_eof == status)
+                {
+                    s.done = true;
+                    --live;
+                    break;
+                }
+                stream_item == status ? ++s.items : ++s.errors;
+            }
+            held += s.parser.buffered();
+        }
+        peak_held = std::max(peak_held, held);
+    }
+    double stream_secs = bench_now() - start;
+    long peak_kb = bench_peak_rss_kb();
+
+    int failed = 0;
+    for (auto& s : sessions)
+    {
+        if (s.items != c.items || s.errors)
+        {
+            ++failed;
+        }
+    }
+
+    double mb = (double) c.text.size() * n_sessions / 1e6;
+    printf("sessions %zu, %zu bytes and %zu items each, %zu chunks\n",
+           n_sessions, c.text.size(), c.items, chunks);
+    printf("%-8s %10s %10s %10s\n", "", "secs", "MB/s", "ns/item");
+    printf("%-8s %10.3f %10.2f %10.1f\n", "whole",
+           whole_secs, mb / whole_secs, whole_secs * 1e9 / (c.items * n_sessions));
+    printf("%-8s %10.3f %10.2f %10.1f\n", "stream",
+           stream_secs, mb / stream_secs, stream_secs * 1e9 / (c.items * n_sessions));
+    printf("held per session: peak %.1f bytes (sizeof %zu), peak RSS growth %ld KB\n",
+           (double) peak_held / n_sessions, sizeof(StreamParser), peak_kb - base_kb);
+
+    if (failed)
+    {
+        fprintf(stderr, "Error: %d sessions parsed the wrong items\n", failed);
+        return 1;
+    }
+
+    lexer_reset();
+    return 0;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,298 @@
+/*!
+ * @file bench/bench_stress.cpp
+ *
+ * @brief This file contains the pathological-input checks.
+ *
+ *          Each case generates a small but hostile input at a quarter of
+ *              its full size and at full size, and runs lex, parse and
+ *              codegen over it in a child process, on a thread with a fixed
+ *              stack, under a timeout. A case fails if a phase crashes or
+ *              times out, or if quadrupling the input grows the phase's
+ *              time or peak memory by more than --max-ratio (linear growth
+ *              is 4x, quadratic 16x).
+ *
+ *          The exit status is non-zero if any case fails.
+ *
+ *          Usage: bench_stress [--case NAME] [--scale F] [--timeout SECS]
+ *                              [--stack-mb MB] [--max-ratio R]
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+#include "bench_util.hpp"
+#include "program.hpp"
+
+/*!
+ * @brief This struct describes one pathological input.
+ */
+struct StressCase
+{
+    const char * p_name;
+    size_t size;                        // The full size parameter.
+    std::string (*p_gen)(size_t n);     // Builds the input.
+};
+
+/*!
+ * @brief These functions build the pathological inputs.
+ */
+static std::string
+gen_deep_parens (size_t n)
+{
+    return std::string(n, '(') + "x" + std::string(n, ')') + ";\n";
+}
+
+static std::string
+gen_long_identifier (size_t n)
+{
+    std::string id = "x" + std::string(n - 1, 'y');
+    return "def f(" + id + ") " + id + ";\n";
+}
+
+static std::string
+gen_long_number (size_t n)
+{
+    return std::string(n, '1') + ".5;\n";
+}
+
+static std::string
+gen_comment_lines (size_t n)
+{
+    std::string out;
+    out.reserve(n * 12 + 4);
+    for (size_t i = 0; i < n; ++i)
+    {
+        out += "# comment\n";
+    }
+    return out + "1;\n";
+}
+
+static std::string
+gen_wide_call (size_t n)
+{
+    std::string out = "extern f(";
+    for (size_t i = 0; i < n; ++i)
+    {
+        out += (i ? " a" : "a") + std::to_string(i);
+    }
+    out += ");\nf(";
+    for (size_t i = 0; i < n; ++i)
+    {
+        out += i ? ", 1" : "1";
+    }
+    return out + ");\n";
+}
+
+static std::string
+gen_left_chain (size_t n)
+{
+    std::string out;
+    out.reserve(n * 4 + 16);
+    out += "def f(x) x";
+    for (size_t i = 1; i < n; ++i)
+    {
+        out += " + x";
+    }
+    return out + ";\n";
+}
+
+static const StressCase cases[] = {
+    { "deep_parens", 1000000, gen_deep_parens },
+    { "long_identifier", 100000, gen_long_identifier },
+    { "long_number", 100000, gen_long_number },
+    { "comment_lines", 1000000, gen_comment_lines },
+    { "wide_call", 100000, gen_wide_call },
+    { "left_chain", 1000000, gen_left_chain },
+};
+
+static const char * phase_names[] = { "lex", "parse", "codegen" };
+
+/*!
+ * @brief This struct holds what a child reports back for one input.
+ */
+struct StressResult
+{
+    double secs[3];
+    long peak_kb[3];
+};
+
+/*!
+ * @brief This struct is the argument of the phase thread.
+ */
+struct StressJob
+{
+    const std::string * p_text;
+    StressResult result;
+};
+
+/*!
+ * @brief This function runs the phases over one input. A parse that ends in
+ *          a diagnostic is fine; only crashes, hangs and growth are not.
+ */
+static void *
+run_phases (void * p_arg)
+{
+    StressJob * p_job = (StressJob *) p_arg;
+    const std::string& text = *p_job->p_text;
+    long base_kb = bench_peak_rss_kb();
+
+    // Parser state is per thread.
+    install_binop_precedence();
+
+    // Lex.
+    bench_reset_peak_rss();
+    double start = bench_now();
+    lexer_set_input(text.data(), text.size());
+    while (gettok() != tok_eof)
+    {
+    }
+    p_job->result.secs[0] = bench_now() - start;
+    p_job->result.peak_kb[0] = bench_peak_rss_kb() - base_kb;
+
+    // Parse.
+    std::vector<Item> items;
+    bench_reset_peak_rss();
+    start = bench_now();
+    bool parsed = parse_program(text, items);
+    p_job->result.secs[1] = bench_now() - start;
+    p_job->result.peak_kb[1] = bench_peak_rss_kb() - base_kb;
+
+    // Codegen.
+    bench_reset_peak_rss();
+    start = bench_now();
+    init_module("stress");
+    if (parsed)
+    {
+        codegen_program(items);
+    }
+    p_job->result.secs[2] = bench_now() - start;
+    p_job->result.peak_kb[2] = bench_peak_rss_kb() - base_kb;
+
+    return nullptr;
+}
+
+/*!
+ * @brief This function runs the phases over one input in a child process,
+ *          on a thread with a stack of the given size, under a timeout.
+ *
+ * @return False if the child crashed, timed out or failed to report.
+ */
+static bool
+run_isolated (const std::string& text, size_t stack_bytes, unsigned timeout, StressResult& out)
+{
+    int fds[2];
+    if (pipe(fds))
+    {
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        close(fds[0]);
+        alarm(timeout);
+
+        // Errors are expected for some inputs; keep the report readable.
+        freopen("/dev/null", "w", stderr);
+
+        StressJob job = { &text, {} };
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, stack_bytes);
+
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, run_phases, &job) || pthread_join(thread, nullptr))
+        {
+            _exit(2);
+        }
+
+        ssize_t n = write(fds[1], &job.result, sizeof(job.result));
+        _exit(n == sizeof(job.result) ? 0 : 2);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status))
+    {
+        printf("    killed by signal %d (%s)\n", WTERMSIG(status),
+               SIGALRM == WTERMSIG(status) ? "timeout" : "crash");
+        return false;
+    }
+
+    return WIFEXITED(status) && 0 == WEXITSTATUS(status) && n == sizeof(out);
+}
+
+int main (int argc, char ** argv)
+{
+    const char * p_only = bench_arg(argc, argv, "--case", nullptr);
+    double scale = atof(bench_arg(argc, argv, "--scale", "1"));
+    unsigned timeout = atoi(bench_arg(argc, argv, "--timeout", "60"));
+    size_t stack_bytes = strtoull(bench_arg(argc, argv, "--stack-mb", "8"), nullptr, 10) << 20;
+    double max_ratio = atof(bench_arg(argc, argv, "--max-ratio", "8"));
+
+    // Growth below these absolute amounts is noise, not complexity.
+    const double min_secs = 0.05;
+    const long min_kb = 16384;
+
+    install_binop_precedence();
+    init_native_target(0);
+
+    int failures = 0;
+    for (const auto& c : cases)
+    {
+        if (p_only && 0 != strcmp(p_only, c.p_name))
+        {
+            continue;
+        }
+
+        size_t full = (size_t) (c.size * scale);
+        if (full < 16)
+        {
+            full = 16;
+        }
+        size_t sizes[2] = { full / 4, full };
+
+        StressResult results[2];
+        bool ok = true;
+        printf("%s\n", c.p_name);
+        for (int i = 0; i < 2 && ok; ++i)
+        {
+            std::string text = c.p_gen(sizes[i]);
+            ok = run_isolated(text, stack_bytes, timeout, results[i]);
+        }
+
+        for (int p = 0; p < 3 && ok; ++p)
+        {
+            double t_ratio = results[1].secs[p] / (results[0].secs[p] > 1e-9 ? results[0].secs[p] : 1e-9);
+            double m_ratio = (double) results[1].peak_kb[p] / (results[0].peak_kb[p] > 0 ? results[0].peak_kb[p] : 1);
+            bool t_bad = t_ratio > max_ratio && results[1].secs[p] > min_secs;
+            bool m_bad = m_ratio > max_ratio && results[1].peak_kb[p] > min_kb;
+
+            printf("    %-8s n=%-8zu %9.4fs %8ldKB   n=%-8zu %9.4fs %8ldKB   x%.1f time x%.1f mem%s\n",
+                   phase_names[p],
+                   sizes[0], results[0].secs[p], results[0].peak_kb[p],
+                   sizes[1], results[1].secs[p], results[1].peak_kb[p],
+                   t_ratio, m_ratio, t_bad || m_bad ? "   SUPER-LINEAR" : "");
+            ok = !t_bad && !m_bad;
+        }
+
+        printf("    %s\n", ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+
+    return failures ? 1 : 0;
+}
+
+/***   end of file   ***/
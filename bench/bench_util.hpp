@@ -0,0 +1,163 @@
+/*!
+ * @file bench/bench_util.hpp
+ *
+ * @brief This file contains timing and statistics helpers shared by the
+ *          benchmarks.
+ */
+
+#ifndef _LLVM_BENCH_UTIL_H
+#define _LLVM_BENCH_UTIL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*!
+ * @brief This function returns a monotonic timestamp in seconds.
+ */
+static inline double
+bench_now (void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * @brief This struct summarizes a set of repeated measurements.
+ */
+struct BenchStats
+{
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double median = 0.0;
+    double max = 0.0;
+};
+
+/*!
+ * @brief This function computes summary statistics over a set of samples.
+ *
+ * @param samples The samples. Sorted in place.
+ */
+static inline BenchStats
+bench_stats (std::vector<double>& samples)
+{
+    BenchStats st;
+    if (samples.empty())
+    {
+        return st;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for (double s : samples)
+    {
+        sum += s;
+    }
+    st.mean = sum / samples.size();
+
+    double var = 0.0;
+    for (double s : samples)
+    {
+        var += (s - st.mean) * (s - st.mean);
+    }
+    st.stddev = samples.size() > 1 ? std::sqrt(var / (samples.size() - 1)) : 0.0;
+
+    st.min = samples.front();
+    st.max = samples.back();
+    size_t mid = samples.size() / 2;
+    st.median = samples.size() % 2
+        ? samples[mid]
+        : (samples[mid - 1] + samples[mid]) / 2.0;
+
+    return st;
+}
+
+/*!
+ * @brief This function looks up the value of a "--name value" argument.
+ *
+ * @return The value, or p_default if the argument is not present.
+ */
+static inline const char *
+bench_arg (int argc, char ** argv, const char * p_name, const char * p_default)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], p_name))
+        {
+            return argv[i + 1];
+        }
+    }
+
+    return p_default;
+}
+
+/*!
+ * @brief This function checks for the presence of a "--name" flag.
+ */
+static inline bool
+bench_flag (int argc, char ** argv, const char * p_name)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], p_name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * @brief This function returns the peak resident set size in KiB since
+ *          process start or the last bench_reset_peak_rss().
+ */
+static inline long
+bench_peak_rss_kb (void)
+{
+    FILE * p_file = fopen("/proc/self/status", "r");
+    if (!p_file)
+    {
+        return -1;
+    }
+
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), p_file))
+    {
+        if (0 == strncmp(line, "VmHWM:", 6))
+        {
+            kb = strtol(line + 6, nullptr, 10);
+            break;
+        }
+    }
+
+    fclose(p_file);
+    return kb;
+}
+
+/*!
+ * @brief This function resets the peak resident set size to the current
+ *          resident set size, so that peaks can be measured per phase.
+ */
+static inline void
+bench_reset_peak_rss (void)
+{
+    FILE * p_file = fopen("/proc/self/clear_refs", "w");
+    if (p_file)
+    {
+        fputs("5", p_file);
+        fclose(p_file);
+    }
+}
+
+#endif // _LLVM_BENCH_UTIL_H
+
+/***   end of file   ***/
@@ -0,0 +1,438 @@
+/*!
+ * @file bench/corpus.cpp
+ *
+ * @brief This file contains deterministic generators for synthetic
+ *          Kaleidoscope corpora used by the benchmarks.
+ */
+
+#include <vector>
+
+#include "corpus.hpp"
+
+/*!
+ * @brief This function appends a random identifier to the output.
+ */
+static void
+append_identifier (std::string& out, CorpusRng& rng, unsigned max_len)
+{
+    static const char alpha[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const char alnum[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+    unsigned len = 1 + rng.below(max_len);
+    out += alpha[rng.below(sizeof(alpha) - 1)];
+    for (unsigned i = 1; i < len; ++i)
+    {
+        out += alnum[rng.below(sizeof(alnum) - 1)];
+    }
+}
+
+/*!
+ * @brief This function appends a random numeric literal to the output.
+ */
+static void
+append_number (std::string& out, CorpusRng& rng)
+{
+    unsigned int_digits = 1 + rng.below(8);
+    for (unsigned i = 0; i < int_digits; ++i)
+    {
+        out += (char) ('0' + rng.below(10));
+    }
+
+    if (rng.below(2))
+    {
+        out += '.';
+        unsigned frac_digits = 1 + rng.below(6);
+        for (unsigned i = 0; i < frac_digits; ++i)
+        {
+            out += (char) ('0' + rng.below(10));
+        }
+    }
+}
+
+/*!
+ * @brief This function appends a comment line to the output.
+ */
+static void
+append_comment (std::string& out, CorpusRng& rng)
+{
+    out += '#';
+    unsigned len = rng.below(72);
+    for (unsigned i = 0; i < len; ++i)
+    {
+        out += (char) (' ' + rng.below(95));
+    }
+    out += '\n';
+}
+
+/*!
+ * @brief This function appends a run of whitespace to the output.
+ */
+static void
+append_whitespace (std::string& out, CorpusRng& rng, unsigned max_len)
+{
+    static const char ws[] = " \t\n\r";
+
+    unsigned len = 1 + rng.below(max_len);
+    for (unsigned i = 0; i < len; ++i)
+    {
+        out += ws[rng.below(sizeof(ws) - 1)];
+    }
+}
+
+/*!
+ * @brief This function appends a single-character token to the output.
+ */
+static void
+append_punct (std::string& out, CorpusRng& rng)
+{
+    static const char punct[] = "+-*<(),;";
+    out += punct[rng.below(sizeof(punct) - 1)];
+}
+
+/*!
+ * @brief This function returns the printable name of a lexer corpus.
+ */
+const char *
+lex_corpus_name (LexCorpus kind)
+{
+    switch (kind)
+    {
+        case lex_identifiers:
+            return "identifiers";
+        case lex_numbers:
+            return "numbers";
+        case lex_comments:
+            return "comments";
+        case lex_whitespace:
+            return "whitespace";
+        case lex_mixed:
+            return "mixed";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * @brief This function generates a lexer corpus of roughly the given size.
+ */
+std::string
+gen_lex_corpus (LexCorpus kind, size_t size, uint64_t seed)
+{
+    CorpusRng rng(seed);
+    std::string out;
+    out.reserve(size + 128);
+
+    while (out.size() < size)
+    {
+        switch (kind)
+        {
+            case lex_identifiers:
+                append_identifier(out, rng, 16);
+                out += ' ';
+            break;
+
+            case lex_numbers:
+                append_number(out, rng);
+                out += ' ';
+            break;
+
+            case lex_comments:
+                append_comment(out, rng);
+            break;
+
+            case lex_whitespace:
+                append_whitespace(out, rng, 64);
+                append_identifier(out, rng, 4);
+            break;
+
+            case lex_mixed:
+                switch (rng.below(8))
+                {
+                    case 0:
+                        out += rng.below(2) ? "def " : "extern ";
+                    break;
+                    case 1:
+                    case 2:
+                        append_identifier(out, rng, 10);
+                    break;
+                    case 3:
+                        append_number(out, rng);
+                    break;
+                    case 4:
+                        append_comment(out, rng);
+                    break;
+                    default:
+                        append_punct(out, rng);
+                    break;
+                }
+                append_whitespace(out, rng, 2);
+            break;
+        }
+    }
+
+    return out;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function appends a random operand, either one of the given
+ *          parameter names or a number.
+ */
+static void
+append_operand (std::string& out, CorpusRng& rng, const char * p_params)
+{
+    if (rng.below(4))
+    {
+        out += p_params[rng.below(3)];
+    }
+    else
+    {
+        append_number(out, rng);
+    }
+}
+
+/*!
+ * @brief This function appends a chain of terms joined by random operators.
+ *
+ * @return The number of AST nodes the chain parses into.
+ */
+static size_t
+append_chain (std::string& out, CorpusRng& rng, size_t terms)
+{
+    static const char ops[] = "+-*<";
+
+    append_operand(out, rng, "abc");
+    for (size_t i = 1; i < terms; ++i)
+    {
+        out += ' ';
+        out += ops[rng.below(sizeof(ops) - 1)];
+        out += ' ';
+        append_operand(out, rng, "abc");
+    }
+
+    return 2 * terms - 1;
+}
+
+/*!
+ * @brief This function returns the printable name of a parser shape.
+ */
+const char *
+parse_shape_name (ParseShape shape)
+{
+    switch (shape)
+    {
+        case shape_small_defs:
+            return "small_defs";
+        case shape_huge_bodies:
+            return "huge_bodies";
+        case shape_left_deep:
+            return "left_deep";
+        case shape_right_deep:
+            return "right_deep";
+        case shape_nested_parens:
+            return "nested_parens";
+        case shape_wide_call:
+            return "wide_call";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * @brief This function generates a parser corpus of the given shape.
+ */
+ParseCorpus
+gen_parse_corpus (ParseShape shape, size_t n, uint64_t seed)
+{
+    CorpusRng rng(seed);
+    ParseCorpus c;
+
+    switch (shape)
+    {
+        case shape_small_defs:
+            for (size_t i = 0; i < n; ++i)
+            {
+                c.text += "def f" + std::to_string(i) + "(a b c) ";
+                c.nodes += 2 + append_chain(c.text, rng, 1 + rng.below(8));
+                c.text += ";\n";
+            }
+            c.items = n;
+        break;
+
+        case shape_huge_bodies:
+            for (size_t i = 0; i < 4; ++i)
+            {
+                c.text += "def g" + std::to_string(i) + "(a b c)\n  ";
+                c.nodes += 2 + append_chain(c.text, rng, n / 4 + 1);
+                c.text += ";\n";
+            }
+            c.items = 4;
+        break;
+
+        case shape_left_deep:
+            c.text += "x";
+            for (size_t i = 1; i < n; ++i)
+            {
+                c.text += " + x";
+            }
+            c.text += ";\n";
+            c.nodes = 2 * n - 1;
+            c.items = 1;
+        break;
+
+        case shape_right_deep:
+            for (size_t i = 1; i < n; ++i)
+            {
+                c.text += "x + (";
+            }
+            c.text += "x";
+            c.text.append(n - 1, ')');
+            c.text += ";\n";
+            c.nodes = 2 * n - 1;
+            c.items = 1;
+        break;
+
+        case shape_nested_parens:
+            c.text.append(n, '(');
+            c.text += "x";
+            for (size_t i = 0; i < n; ++i)
+            {
+                c.text += ") + 1";
+            }
+            c.text += ";\n";
+            c.nodes = 2 * n + 1;
+            c.items = 1;
+        break;
+
+        case shape_wide_call:
+            c.text += "f(x";
+            for (size_t i = 1; i < n; ++i)
+            {
+                c.text += ", x";
+            }
+            c.text += ");\n";
+            c.nodes = n + 1;
+            c.items = 1;
+        break;
+    }
+
+    return c;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This struct describes a callable function while generating a
+ *          program.
+ */
+struct GenFunc
+{
+    std::string name;
+    unsigned arity;
+};
+
+/*!
+ * @brief This function appends a random expression over the given number of
+ *          parameters, possibly calling functions already defined.
+ */
+static void
+append_program_expr (std::string& out,
+                     CorpusRng& rng,
+                     unsigned params,
+                     const std::vector<GenFunc>& funcs,
+                     unsigned depth)
+{
+    static const char ops[] = "+-*<";
+    static const char names[] = "abcd";
+
+    unsigned pick = rng.below(10);
+    if (0 == depth || pick < 3)
+    {
+        if (params && rng.below(3))
+        {
+            out += names[rng.below(params)];
+        }
+        else
+        {
+            append_number(out, rng);
+        }
+    }
+    else if (pick < 7 || funcs.empty())
+    {
+        append_program_expr(out, rng, params, funcs, depth - 1);
+        out += ' ';
+        out += ops[rng.below(sizeof(ops) - 1)];
+        out += ' ';
+        append_program_expr(out, rng, params, funcs, depth - 1);
+    }
+    else
+    {
+        // Prefer recently defined callees, as real code tends to.
+        size_t window = funcs.size() < 64 ? funcs.size() : 64;
+        const GenFunc& f = funcs[funcs.size() - 1 - rng.below(window)];
+
+        out += f.name;
+        out += '(';
+        for (unsigned i = 0; i < f.arity; ++i)
+        {
+            if (i)
+            {
+                out += ", ";
+            }
+            append_program_expr(out, rng, params, funcs, depth - 1);
+        }
+        out += ')';
+    }
+}
+
+/*!
+ * @brief This function generates a realistic program.
+ */
+ParseCorpus
+gen_program (size_t lines, uint64_t seed)
+{
+    static const char * externs[] = { "sin", "cos", "sqrt", "exp", "log", "fabs" };
+    static const char names[] = "abcd";
+
+    CorpusRng rng(seed);
+    ParseCorpus c;
+    std::vector<GenFunc> funcs;
+
+    for (size_t line = 0; line < lines; ++line)
+    {
+        unsigned pick = rng.below(20);
+        if (line < sizeof(externs) / sizeof(externs[0]))
+        {
+            // A prelude of externs.
+            c.text += "extern ";
+            c.text += externs[line];
+            c.text += "(x);\n";
+            funcs.push_back({ externs[line], 1 });
+        }
+        else if (pick < 3)
+        {
+            append_program_expr(c.text, rng, 0, funcs, 3);
+            c.text += ";\n";
+        }
+        else
+        {
+            GenFunc f = { "h" + std::to_string(line), 1 + rng.below(4) };
+            c.text += "def " + f.name + "(";
+            for (unsigned i = 0; i < f.arity; ++i)
+            {
+                c.text += i ? " " : "";
+                c.text += names[i];
+            }
+            c.text += ") ";
+            append_program_expr(c.text, rng, f.arity, funcs, 3);
+            c.text += ";\n";
+            funcs.push_back(f);
+        }
+    }
+
+    c.items = lines;
+    return c;
+}
+
+/***   end of file   ***/
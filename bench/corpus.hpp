@@ -0,0 +1,130 @@
+/*!
+ * @file bench/corpus.hpp
+ *
+ * @brief This file contains deterministic generators for synthetic
+ *          Kaleidoscope corpora used by the benchmarks.
+ */
+
+#ifndef _LLVM_CORPUS_H
+#define _LLVM_CORPUS_H
+
+#include <cstdint>
+#include <string>
+
+/*!
+ * @brief This class is a small seeded PRNG (splitmix64).
+ *
+ *          The standard library distributions are implementation defined,
+ *              so the generators draw from this directly to produce the
+ *              same corpus for the same seed on every platform.
+ */
+class CorpusRng
+{
+private:
+    uint64_t state;
+
+public:
+    // Ctor.
+    CorpusRng(uint64_t seed)
+        : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Returns a value in [0, bound).
+    uint32_t below(uint32_t bound)
+    {
+        return (uint32_t) (next() % bound);
+    }
+};
+
+/*!
+ * @brief This enum contains the shapes of lexer corpora.
+ */
+enum LexCorpus
+{
+    lex_identifiers,
+    lex_numbers,
+    lex_comments,
+    lex_whitespace,
+    lex_mixed,
+};
+
+/*!
+ * @brief This function returns the printable name of a lexer corpus.
+ */
+const char *
+lex_corpus_name (LexCorpus kind);
+
+/*!
+ * @brief This function generates a lexer corpus of roughly the given size.
+ *
+ * @param kind The shape of the corpus.
+ * @param size The target size in bytes.
+ * @param seed The PRNG seed. The same seed yields the same corpus.
+ */
+std::string
+gen_lex_corpus (LexCorpus kind, size_t size, uint64_t seed);
+
+/*!
+ * @brief This enum contains the AST shapes of parser corpora.
+ */
+enum ParseShape
+{
+    shape_small_defs,       // Many short definitions.
+    shape_huge_bodies,      // A few definitions with very long bodies.
+    shape_left_deep,        // x + x + ... + x
+    shape_right_deep,       // x + (x + (... + x))
+    shape_nested_parens,    // ((((x) + 1) + 1) ...)
+    shape_wide_call,        // f(x, x, ..., x)
+};
+
+/*!
+ * @brief This struct holds a generated parser corpus and its expected size.
+ */
+struct ParseCorpus
+{
+    std::string text;
+    size_t nodes = 0;   // ExprAST, PrototypeAST and FunctionAST nodes.
+    size_t items = 0;   // Top-level definitions and expressions.
+};
+
+/*!
+ * @brief This function returns the printable name of a parser shape.
+ */
+const char *
+parse_shape_name (ParseShape shape);
+
+/*!
+ * @brief This function generates a parser corpus of the given shape.
+ *
+ * @param shape The AST shape to generate.
+ * @param n The size parameter: definitions for shape_small_defs, and terms,
+ *              nesting levels or arguments for the others.
+ * @param seed The PRNG seed. The same seed yields the same corpus.
+ */
+ParseCorpus
+gen_parse_corpus (ParseShape shape, size_t n, uint64_t seed);
+
+/*!
+ * @brief This function generates a realistic program: a few externs, a
+ *          call graph of helper definitions that call earlier helpers and
+ *          externs, and top-level expressions that call into it.
+ *
+ *          Every top-level item is on its own line, so the item count is
+ *              the line count. The node count is not tracked.
+ *
+ * @param lines The number of lines to generate.
+ * @param seed The PRNG seed. The same seed yields the same program.
+ */
+ParseCorpus
+gen_program (size_t lines, uint64_t seed);
+
+#endif // _LLVM_CORPUS_H
+
+/***   end of file   ***/
@@ -0,0 +1,112 @@
+/*!
+ * @file bench/program.cpp
+ *
+ * @brief This file contains helpers that parse and codegen a whole program
+ *          held in memory.
+ */
+
+#include <cstdio>
+
+#include "program.hpp"
+
+/*!
+ * @brief This function parses every top-level item of a program.
+ */
+bool
+parse_program (const std::string& text, std::vector<Item>& items)
+{
+    lexer_set_input(text.data(), text.size());
+    get_next_token();
+
+    while (cur_tok != tok_eof)
+    {
+        Item item;
+        switch (cur_tok)
+        {
+            case ';':
+                get_next_token();
+                continue;
+
+            case tok_def:
+                item.def = parse_definition();
+            break;
+
+            case tok_extern:
+                item.proto = parse_extern();
+            break;
+
+            default:
+                item.def = parse_top_level_expr();
+            break;
+        }
+
+        if (!item.def && !item.proto)
+        {
+            return false;
+        }
+        items.push_back(std::move(item));
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function generates IR for every item into g_module.
+ */
+bool
+codegen_program (std::vector<Item>& items)
+{
+    size_t anon = 0;
+    for (auto& item : items)
+    {
+        if (item.proto)
+        {
+            if (!item.proto->codegen())
+            {
+                return false;
+            }
+            g_function_protos[item.proto->get_name()] =
+                std::make_unique<PrototypeAST>(*item.proto);
+            continue;
+        }
+
+        llvm::Function * p_func = item.def->codegen();
+        if (!p_func)
+        {
+            return false;
+        }
+
+        if (p_func->getName() == "__anon_expr")
+        {
+            p_func->setName("__anon_expr." + std::to_string(anon++));
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function reads a whole file into a string.
+ */
+bool
+read_file (const char * p_path, std::string& out)
+{
+    FILE * p_file = fopen(p_path, "rb");
+    if (!p_file)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", p_path);
+        return false;
+    }
+
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p_file)) > 0)
+    {
+        out.append(buf, n);
+    }
+
+    fclose(p_file);
+    return true;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,58 @@
+/*!
+ * @file bench/program.hpp
+ *
+ * @brief This file contains helpers that parse and codegen a whole program
+ *          held in memory, for the benchmarks that drive the compiler
+ *          directly rather than through the REPL.
+ */
+
+#ifndef _LLVM_PROGRAM_H
+#define _LLVM_PROGRAM_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "parser.hpp"
+
+/*!
+ * @brief This struct holds one parsed top-level item: a definition or
+ *          top-level expression in def, or an extern in proto.
+ */
+struct Item
+{
+    std::unique_ptr<FunctionAST> def;
+    std::unique_ptr<PrototypeAST> proto;
+};
+
+/*!
+ * @brief This function parses every top-level item of a program.
+ *
+ * @return False if any item fails to parse.
+ */
+bool
+parse_program (const std::string& text, std::vector<Item>& items);
+
+/*!
+ * @brief This function generates IR for every item into g_module.
+ *
+ *          Externs are recorded in g_function_protos. Top-level
+ *              expressions are renamed "__anon_expr.N" so that they can
+ *              share the module.
+ *
+ * @return False if codegen fails for any item.
+ */
+bool
+codegen_program (std::vector<Item>& items);
+
+/*!
+ * @brief This function reads a whole file into a string.
+ *
+ * @return False if the file cannot be read.
+ */
+bool
+read_file (const char * p_path, std::string& out);
+
+#endif // _LLVM_PROGRAM_H
+
+/***   end of file   ***/
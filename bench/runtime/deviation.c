@@ -0,0 +1,10 @@
+/* Reference for deviation.ks. */
+
+#include <math.h>
+
+double dev(double x) { return 0.0625 * (fabs(x - 1) + fabs(x - 2) + fabs(x - 3) + fabs(x - 4) + fabs(x - 5) + fabs(x - 6) + fabs(x - 7) + fabs(x - 8) + fabs(x - 9) + fabs(x - 10) + fabs(x - 11) + fabs(x - 12) + fabs(x - 13) + fabs(x - 14) + fabs(x - 15) + fabs(x - 16)); }
+double dev4(double x) { return dev(dev(dev(dev(x)))); }
+double dev16(double x) { return dev4(dev4(dev4(dev4(x)))); }
+double dev64(double x) { return dev16(dev16(dev16(dev16(x)))); }
+
+double kernel(double x) { return dev64(x); }
@@ -0,0 +1,29 @@
+/* Reference for fib.ks: the same per-level call tree. */
+
+double fib1(double x) { return x; }
+double fib2(double x) { return x; }
+double fib3(double x) { return fib2(x) + fib1(x); }
+double fib4(double x) { return fib3(x) + fib2(x); }
+double fib5(double x) { return fib4(x) + fib3(x); }
+double fib6(double x) { return fib5(x) + fib4(x); }
+double fib7(double x) { return fib6(x) + fib5(x); }
+double fib8(double x) { return fib7(x) + fib6(x); }
+double fib9(double x) { return fib8(x) + fib7(x); }
+double fib10(double x) { return fib9(x) + fib8(x); }
+double fib11(double x) { return fib10(x) + fib9(x); }
+double fib12(double x) { return fib11(x) + fib10(x); }
+double fib13(double x) { return fib12(x) + fib11(x); }
+double fib14(double x) { return fib13(x) + fib12(x); }
+double fib15(double x) { return fib14(x) + fib13(x); }
+double fib16(double x) { return fib15(x) + fib14(x); }
+double fib17(double x) { return fib16(x) + fib15(x); }
+double fib18(double x) { return fib17(x) + fib16(x); }
+double fib19(double x) { return fib18(x) + fib17(x); }
+double fib20(double x) { return fib19(x) + fib18(x); }
+double fib21(double x) { return fib20(x) + fib19(x); }
+double fib22(double x) { return fib21(x) + fib20(x); }
+double fib23(double x) { return fib22(x) + fib21(x); }
+double fib24(double x) { return fib23(x) + fib22(x); }
+double fib25(double x) { return fib24(x) + fib23(x); }
+
+double kernel(double x) { return fib25(x); }
@@ -0,0 +1,13 @@
+/* Reference for integrate.ks. */
+
+#include <math.h>
+
+double f(double t) { return t * sin(t) + 1; }
+double s1(double a, double h) { return f(a + 0.5 * h) * h; }
+double s4(double a, double h) { return s1(a, h) + s1(a + h, h) + s1(a + 2 * h, h) + s1(a + 3 * h, h); }
+double s16(double a, double h) { return s4(a, h) + s4(a + 4 * h, h) + s4(a + 8 * h, h) + s4(a + 12 * h, h); }
+double s64(double a, double h) { return s16(a, h) + s16(a + 16 * h, h) + s16(a + 32 * h, h) + s16(a + 48 * h, h); }
+double s256(double a, double h) { return s64(a, h) + s64(a + 64 * h, h) + s64(a + 128 * h, h) + s64(a + 192 * h, h); }
+double s1024(double a, double h) { return s256(a, h) + s256(a + 256 * h, h) + s256(a + 512 * h, h) + s256(a + 768 * h, h); }
+
+double kernel(double x) { return s1024(0, x * 0.0009765625); }
@@ -0,0 +1,43 @@
+/* Reference for mandelbrot.ks. */
+
+/* Kaleidoscope's "<" is an unordered compare returning 1.0 or 0.0. */
+static double lt(double a, double b) { return !(a >= b); }
+
+double m0(double zr, double zi, double cr, double ci) { return lt(zr * zr + zi * zi, 4); }
+double m1(double zr, double zi, double cr, double ci) { return m0(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m2(double zr, double zi, double cr, double ci) { return m1(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m3(double zr, double zi, double cr, double ci) { return m2(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m4(double zr, double zi, double cr, double ci) { return m3(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m5(double zr, double zi, double cr, double ci) { return m4(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m6(double zr, double zi, double cr, double ci) { return m5(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m7(double zr, double zi, double cr, double ci) { return m6(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m8(double zr, double zi, double cr, double ci) { return m7(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m9(double zr, double zi, double cr, double ci) { return m8(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m10(double zr, double zi, double cr, double ci) { return m9(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m11(double zr, double zi, double cr, double ci) { return m10(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m12(double zr, double zi, double cr, double ci) { return m11(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m13(double zr, double zi, double cr, double ci) { return m12(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m14(double zr, double zi, double cr, double ci) { return m13(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m15(double zr, double zi, double cr, double ci) { return m14(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m16(double zr, double zi, double cr, double ci) { return m15(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m17(double zr, double zi, double cr, double ci) { return m16(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m18(double zr, double zi, double cr, double ci) { return m17(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m19(double zr, double zi, double cr, double ci) { return m18(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m20(double zr, double zi, double cr, double ci) { return m19(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m21(double zr, double zi, double cr, double ci) { return m20(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m22(double zr, double zi, double cr, double ci) { return m21(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m23(double zr, double zi, double cr, double ci) { return m22(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m24(double zr, double zi, double cr, double ci) { return m23(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m25(double zr, double zi, double cr, double ci) { return m24(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m26(double zr, double zi, double cr, double ci) { return m25(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m27(double zr, double zi, double cr, double ci) { return m26(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m28(double zr, double zi, double cr, double ci) { return m27(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m29(double zr, double zi, double cr, double ci) { return m28(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m30(double zr, double zi, double cr, double ci) { return m29(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m31(double zr, double zi, double cr, double ci) { return m30(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+double m32(double zr, double zi, double cr, double ci) { return m31(zr * zr - zi * zi + cr, 2 * zr * zi + ci, cr, ci); }
+
+double point(double cr, double ci) { return m32(0, 0, cr, ci); }
+double row(double ci) { return point(-2.0, ci) + point(-1.6875, ci) + point(-1.375, ci) + point(-1.0625, ci) + point(-0.75, ci) + point(-0.4375, ci) + point(-0.125, ci) + point(0.1875, ci); }
+
+double kernel(double y) { return row(y) + row(y + 0.25) + row(y + 0.5) + row(y + 0.75); }
@@ -0,0 +1,8 @@
+/* Reference for newton.ks. */
+
+double step(double a, double x) { return x * (2 - a * x); }
+double step4(double a, double x) { return step(a, step(a, step(a, step(a, x)))); }
+double step16(double a, double x) { return step4(a, step4(a, step4(a, step4(a, x)))); }
+double step64(double a, double x) { return step16(a, step16(a, step16(a, step16(a, x)))); }
+
+double kernel(double a) { return step64(a, 0.1); }
@@ -0,0 +1,9 @@
+/* Reference for poly.ks. */
+
+double poly(double x) { return 3*x*x*x*x*x*x*x + 2*x*x*x*x*x*x - 5*x*x*x*x*x + x*x*x*x - 7*x*x*x + 4*x*x - 9*x + 11; }
+double p4(double x, double h) { return poly(x) + poly(x + h) + poly(x + 2 * h) + poly(x + 3 * h); }
+double p16(double x, double h) { return p4(x, h) + p4(x + 4 * h, h) + p4(x + 8 * h, h) + p4(x + 12 * h, h); }
+double p64(double x, double h) { return p16(x, h) + p16(x + 16 * h, h) + p16(x + 32 * h, h) + p16(x + 48 * h, h); }
+double p256(double x, double h) { return p64(x, h) + p64(x + 64 * h, h) + p64(x + 128 * h, h) + p64(x + 192 * h, h); }
+
+double kernel(double x) { return p256(x, 0.001); }
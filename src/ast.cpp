@@ -5,14 +5,50 @@
  */
 
 #include "ast.hpp"
+#include "debuginfo.hpp"
+#include "reassoc.hpp"
+#include "simplify.hpp"
+#include "metrics.hpp"
+#include "remarks.hpp"
+
+#include <algorithm>
 
 /*!
  * @brief These are static globals for codegen functions.
  */
-std::unique_ptr<llvm::LLVMContext> g_context = std::make_unique<llvm::LLVMContext>();
-std::unique_ptr<llvm::IRBuilder<>> g_builder = std::make_unique<llvm::IRBuilder<>>(*g_context);
-std::unique_ptr<llvm::Module> g_module;
-std::map<std::string, llvm::Value *> g_named_values;
+thread_local std::unique_ptr<llvm::LLVMContext> g_context = std::make_unique<llvm::LLVMContext>();
+thread_local std::unique_ptr<llvm::IRBuilder<>> g_builder = std::make_unique<llvm::IRBuilder<>>(*g_context);
+thread_local std::unique_ptr<llvm::Module> g_module;
+thread_local std::map<std::string, llvm::Value *> g_named_values;
+
+/*!
+ * @brief This map holds the prototype of every function seen so far, so that
+ *          calls can be emitted into modules other than the defining one.
+ */
+thread_local std::map<std::string, std::unique_ptr<PrototypeAST>> g_function_protos;
+
+/*!
+ * @brief This map holds definitions parsed but not yet compiled, under
+ *          demand-driven codegen.
+ */
+thread_local std::map<std::string, std::unique_ptr<FunctionAST>> g_deferred_functions;
+
+// Top-level expressions are generated under this name. Each is run once and
+// removed, so it is never recorded as defined.
+static const char * anon_expr_name = "__anon_expr";
+
+/*!
+ * @brief This is the deepest expression codegen or the evaluator will walk.
+ *          Both walks keep their own stack, so this bounds memory rather
+ *          than protecting the thread's stack.
+ */
+unsigned max_codegen_depth = 1u << 22;
+
+/*!
+ * @brief These are the floating point relaxations in effect; none by default,
+ *          which keeps IEEE semantics and the source's evaluation order.
+ */
+llvm::FastMathFlags g_fp_flags;
 
 /*!
  * @brief This function is used for error handling.
@@ -48,13 +84,141 @@ log_error_v (const char * p_str)
     return nullptr;
 }
 
+/*!
+ * @brief This function looks up a function by name in the current module,
+ *          emitting a declaration from its recorded prototype if it was
+ *          defined in an earlier module.
+ */
+llvm::Function *
+get_function (const std::string& name)
+{
+    // Check whether the function is already in the current module.
+    if (llvm::Function * f = g_module->getFunction(name))
+    {
+        return f;
+    }
+
+    // Otherwise codegen a declaration from the recorded prototype.
+    auto it = g_function_protos.find(name);
+    if (it != g_function_protos.end())
+    {
+        return it->second->codegen();
+    }
+
+    return nullptr;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function generates code for an expression tree.
+ *
+ *          The tree is walked in post-order with an explicit stack, so the
+ *              code is emitted in the same order as a recursive walk would
+ *              emit it, but the depth of the tree is not limited by the
+ *              depth of the thread's stack.
+ */
+llvm::Value *
+ExprAST::codegen()
+{
+    // A node being generated, with the next operand to visit and where its
+    // operands' values start on the value stack.
+    struct Frame
+    {
+        ExprAST * p_node;
+        size_t next;
+        size_t base;
+    };
+
+    std::vector<Frame> frames;
+    std::vector<llvm::Value *> values;
+
+    if (!codegen_enter())
+    {
+        return nullptr;
+    }
+    frames.push_back({ this, 0, 0 });
+
+    while (!frames.empty())
+    {
+        Frame& top = frames.back();
+
+        // Descend into the next operand.
+        if (top.next < top.p_node->num_operands())
+        {
+            ExprAST * p_operand = top.p_node->get_operand(top.next++);
+            if (frames.size() >= max_codegen_depth)
+            {
+                return log_error_v("Expression nested too deeply to generate code");
+            }
+            if (!p_operand->codegen_enter())
+            {
+                return nullptr;
+            }
+            frames.push_back({ p_operand, 0, values.size() });
+            continue;
+        }
+
+        // Every operand is done; emit the node in their place.
+        if (g_debug_info)
+        {
+            debug_set_location(debug_node_location(top.p_node));
+        }
+        llvm::Value * v = top.p_node->codegen_emit(values.data() + top.base);
+        if (!v)
+        {
+            return nullptr;
+        }
+        values.resize(top.base);
+        values.push_back(v);
+        frames.pop_back();
+    }
+
+    return values.back();
+}
+
+/*!
+ * @brief This function frees the operands of a node. Each freed node hands its
+ *          own operands to the worklist first, so no destructor recurses.
+ */
+void
+ExprAST::destroy_operands()
+{
+    std::vector<std::unique_ptr<ExprAST>> pending;
+    release_operands(pending);
+
+    while (!pending.empty())
+    {
+        std::unique_ptr<ExprAST> node = std::move(pending.back());
+        pending.pop_back();
+        if (node)
+        {
+            node->release_operands(pending);
+        }
+    }
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function destroys an expression node, dropping its location
+ *          so that a node allocated in its place does not take it.
+ */
+ExprAST::~ExprAST()
+{
+    if (g_debug_info)
+    {
+        debug_forget_location(this);
+    }
+}
+
 /******************************************************************************/
 
 /*!
  * @brief This function generates code for a NumberExprAST object.
  */
 llvm::Value *
-NumberExprAST::codegen()
+NumberExprAST::codegen_emit(llvm::Value * const *)
 {
     return llvm::ConstantFP::get(*g_context, llvm::APFloat(val));
 }
@@ -65,7 +229,7 @@ NumberExprAST::codegen()
  * @brief This function generates code for a VariableExprAST object.
  */
 llvm::Value *
-VariableExprAST::codegen()
+VariableExprAST::codegen_emit(llvm::Value * const *)
 {
     llvm::Value * v = g_named_values[name];
     if (!v)
@@ -79,26 +243,64 @@ VariableExprAST::codegen()
 /******************************************************************************/
 
 /*!
- * @brief This function generates code for a BinaryExprAST object.
+ * @brief This function fuses an add with a multiply feeding it into a call to
+ *          llvm.fmuladd, which the backend emits as an FMA wherever that is
+ *          faster, at every optimization level.
+ *
+ * @return The fused value, or nullptr if neither operand is a multiply used
+ *          only here.
  */
-llvm::Value *
-BinaryExprAST::codegen()
+static llvm::Value *
+emit_fmuladd (llvm::Value * l, llvm::Value * r)
 {
-    // Generate code for the left and right hand side of the operator.
-    llvm::Value * l = lhs->codegen();
-    llvm::Value * r = rhs->codegen();
-
-    // Ensure both returned without error.
-    if (!l || !r)
+    for (int i = 0; i < 2; ++i)
     {
-        return nullptr;
+        llvm::Value * p_product = i ? r : l;
+        llvm::Value * p_addend = i ? l : r;
+
+        auto * p_mul = llvm::dyn_cast<llvm::BinaryOperator>(p_product);
+        if (!p_mul || llvm::Instruction::FMul != p_mul->getOpcode() || !p_mul->use_empty())
+        {
+            continue;
+        }
+
+        llvm::Value * fused = g_builder->CreateIntrinsic(
+            llvm::Intrinsic::fmuladd,
+            { p_mul->getType() },
+            { p_mul->getOperand(0), p_mul->getOperand(1), p_addend },
+            nullptr,
+            "addtmp"
+        );
+        p_mul->eraseFromParent();
+
+        return fused;
     }
 
+    return nullptr;
+}
+
+/*!
+ * @brief This function generates code for a BinaryExprAST object, once the
+ *          left and right hand sides have been generated.
+ */
+llvm::Value *
+BinaryExprAST::codegen_emit(llvm::Value * const * p_operands)
+{
+    llvm::Value * l = p_operands[0];
+    llvm::Value * r = p_operands[1];
+
     // Handle various binary operators.
     switch (op)
     {
-        // Addition.
+        // Addition, fused with a multiply if contraction is allowed.
         case '+':
+            if (g_fp_flags.allowContract())
+            {
+                if (llvm::Value * fused = emit_fmuladd(l, r))
+                {
+                    return fused;
+                }
+            }
             return g_builder->CreateFAdd(l, r, "addtmp");
         break;
 
@@ -126,40 +328,77 @@ BinaryExprAST::codegen()
     }
 }
 
+void
+BinaryExprAST::release_operands(std::vector<std::unique_ptr<ExprAST>>& out)
+{
+    out.push_back(std::move(lhs));
+    out.push_back(std::move(rhs));
+}
+
 /******************************************************************************/
 
 /*!
- * @brief This function generates code for a CallExprAST object.
+ * @brief This function resolves the callee of a CallExprAST object, before
+ *          code for its args is generated.
  */
-llvm::Value *
-CallExprAST::codegen()
+bool
+CallExprAST::codegen_enter()
 {
-    // Look up the name in the global module table.
-    llvm::Function * callee_f = g_module->getFunction(callee);
-    if (!callee_f)
+    // Look up the name in the global module table, declaring it in the
+    // module if it was defined in an earlier one.
+    llvm::Function * p_callee_fn = get_function(callee);
+    if (!p_callee_fn)
     {
-        return log_error_v("Unknown function referenced");
+        log_error_v("Unknown function referenced");
+        return false;
     }
 
     // Check that correct number of args were passed.
-    if (callee_f->arg_size() != args.size())
+    if (p_callee_fn->arg_size() != args.size())
     {
-        return log_error_v("Incorrect number of args passed");
+        log_error_v("Incorrect number of args passed");
+        return false;
     }
 
-    // Create a vector to hold code for all args.
-    std::vector<llvm::Value *> args_v;
-    for (unsigned i = 0, e = args.size(); i != e; ++i)
+    return true;
+}
+
+/*!
+ * @brief This function generates code for a CallExprAST object, once code for
+ *          its args has been generated.
+ */
+llvm::Value *
+CallExprAST::codegen_emit(llvm::Value * const * p_operands)
+{
+    // Create the call IR with the callee, which codegen_enter found or
+    // declared in the module, and args.
+    llvm::Function * p_callee_fn = g_module->getFunction(callee);
+    llvm::CallInst * p_call = g_builder->CreateCall(
+        p_callee_fn,
+        llvm::makeArrayRef(p_operands, args.size()),
+        "calltmp"
+    );
+
+    // A function the program defines is not the libm one of the same name,
+    // whose calls LLVM would fold or expand.
+    auto it = g_function_protos.find(callee);
+    if (!p_callee_fn->isDeclaration()
+        || (it != g_function_protos.end() && it->second->is_defined())
+        || g_deferred_functions.count(callee))
     {
-        args_v.push_back(args[i]->codegen());
-        if (!args_v.back())
-        {
-            return nullptr;
-        }
+        p_call->addFnAttr(llvm::Attribute::NoBuiltin);
     }
+    return p_call;
+}
 
-    // Create the call IR with the callee and args.
-    return g_builder->CreateCall(callee_f, args_v, "calltmp");
+void
+CallExprAST::release_operands(std::vector<std::unique_ptr<ExprAST>>& out)
+{
+    for (auto& arg : args)
+    {
+        out.push_back(std::move(arg));
+    }
+    args.clear();
 }
 
 /******************************************************************************/
@@ -201,6 +440,13 @@ PrototypeAST::codegen()
 llvm::Function *
 FunctionAST::codegen()
 {
+    // A body generated into an earlier module is in the JIT by now.
+    auto it = g_function_protos.find(proto->get_name());
+    if (it != g_function_protos.end() && it->second->is_defined())
+    {
+        return (llvm::Function *) log_error_v("Function cannot be redefined");
+    }
+
     // Check for an existing function from a previous extern decl.
     llvm::Function * the_func = g_module->getFunction(proto->get_name());
 
@@ -231,6 +477,24 @@ FunctionAST::codegen()
 
     // Set the builder's insertion point.
     g_builder->SetInsertPoint(bb);
+    if (g_debug_info)
+    {
+        debug_begin_function(*the_func, proto->get_loc());
+    }
+
+    // Rewrite the body into a cheaper equivalent before emitting it.
+    if (g_simplify)
+    {
+        simplify_function(proto->get_name(), body);
+    }
+
+    // Reordering changes rounding, so it follows the floating point flags
+    // alone, whether or not the body was simplified.
+    if (g_fp_flags.allowReassoc())
+    {
+        rewrite_polynomials(body);
+        balance_chains(body);
+    }
 
     // Record the function args in the named_values map.
     g_named_values.clear();
@@ -243,19 +507,72 @@ FunctionAST::codegen()
     llvm::Value * ret_val = body->codegen();
     if (!ret_val)
     {
-        // Error reading body, remove the function.
-        the_func->eraseFromParent();
+        // Error reading body, remove the function. Calls already generated
+        // to it keep it as a declaration, as if only its extern was seen.
+        debug_end_function();
+        the_func->deleteBody();
+        if (the_func->use_empty())
+        {
+            the_func->eraseFromParent();
+        }
         return nullptr;
     }
 
     // Finish off the function.
     g_builder->CreateRet(ret_val);
+    debug_end_function();
 
     // Validate the generated code, checking for consistency.
     llvm::verifyFunction(*the_func);
+    metric_functions_compiled.add();
+
+    // Record the prototype so later modules can call this function.
+    auto p_proto = std::make_unique<PrototypeAST>(*proto);
+    if (proto->get_name() != anon_expr_name)
+    {
+        p_proto->set_defined();
+    }
+    g_function_protos[proto->get_name()] = std::move(p_proto);
+    if (g_remarks)
+    {
+        remarks_note_definition(*proto);
+    }
 
     // Return the finished function.
     return the_func;
 }
 
+/******************************************************************************/
+
+void
+CallExprAST::collect_callee(std::vector<std::string>& callees) const
+{
+    callees.push_back(callee);
+}
+
+std::vector<std::string>
+FunctionAST::get_callees() const
+{
+    std::vector<std::string> callees;
+
+    // Walk the body with an explicit stack, as codegen does.
+    std::vector<const ExprAST *> pending = { body.get() };
+    while (!pending.empty())
+    {
+        const ExprAST * p_node = pending.back();
+        pending.pop_back();
+
+        p_node->collect_callee(callees);
+        for (size_t i = 0, e = p_node->num_operands(); i != e; ++i)
+        {
+            pending.push_back(p_node->get_operand(i));
+        }
+    }
+
+    std::sort(callees.begin(), callees.end());
+    callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+
+    return callees;
+}
+
 /***   end of file   ***/
@@ -13,21 +13,53 @@
 #include <vector>
 
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/PointerIntPair.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 
-extern std::unique_ptr<llvm::LLVMContext> g_context;
-extern std::unique_ptr<llvm::IRBuilder<>> g_builder;
-extern std::unique_ptr<llvm::Module> g_module;
-extern std::map<std::string, llvm::Value *> g_named_values;
+#include "lexer.hpp"
+
+// Codegen state is per thread, so that independent compilations can run
+// concurrently, each with its own LLVMContext.
+extern thread_local std::unique_ptr<llvm::LLVMContext> g_context;
+extern thread_local std::unique_ptr<llvm::IRBuilder<>> g_builder;
+extern thread_local std::unique_ptr<llvm::Module> g_module;
+extern thread_local std::map<std::string, llvm::Value *> g_named_values;
+
+class PrototypeAST;
+class FunctionAST;
+extern thread_local std::map<std::string, std::unique_ptr<PrototypeAST>> g_function_protos;
+extern thread_local std::map<std::string, std::unique_ptr<FunctionAST>> g_interp_functions;
+extern thread_local std::map<std::string, std::unique_ptr<FunctionAST>> g_deferred_functions;
+
+// The deepest expression codegen or the evaluator will walk before giving up
+// with an error.
+extern unsigned max_codegen_depth;
+
+// The floating point relaxations the program was compiled with. The builder
+// tags every instruction with them, and the frontend passes check them
+// before rewriting anything that is not exact.
+extern llvm::FastMathFlags g_fp_flags;
+
+/*!
+ * @brief These are the kinds of expression node.
+ */
+enum ExprKind
+{
+    expr_number,
+    expr_variable,
+    expr_binary,
+    expr_call,
+};
 
 /*!
  * @brief This class is the base class for all expression nodes.
@@ -36,10 +68,52 @@ class ExprAST
 {
 public:
     // Virtual destructor.
-    virtual ~ExprAST() = default;
+    virtual ~ExprAST();
+
+    // Generates code for this expression and its operands, walking the tree
+    // with an explicit stack rather than recursing.
+    llvm::Value * codegen();
+
+    // The kind of node, for passes that rewrite the tree.
+    virtual ExprKind get_kind() const = 0;
+
+    // Tree-walking evaluation function. It recurses while the tree is
+    // shallow and walks deeper operands with an explicit stack.
+    virtual double evaluate() = 0;
+
+    // The operands, in the order their code is generated.
+    virtual size_t num_operands() const { return 0; }
+    virtual ExprAST * get_operand(size_t) const { return nullptr; }
+
+    // Appends the name of the function this node calls, if any.
+    virtual void collect_callee(std::vector<std::string>&) const {}
+
+protected:
+    // Runs before the operands are generated; false stops codegen.
+    virtual bool codegen_enter() { return true; }
+
+    // Generates code for this node, given the values of its operands.
+    virtual llvm::Value * codegen_emit(llvm::Value * const * p_operands) = 0;
+
+    // Evaluates this node and its operands with an explicit stack, so that
+    // the depth of the tree is not limited by the thread's stack.
+    double evaluate_walk();
+
+    // Runs before the operands are evaluated; false stops the evaluation.
+    virtual bool evaluate_enter() { return true; }
+
+    // Evaluates this node, given the values of its operands.
+    virtual double evaluate_emit(const double * p_operands) = 0;
 
-    // Pure virtual codegen function.
-    virtual llvm::Value * codegen() = 0;
+    // The definition this node calls, whose body the explicit-stack walk
+    // evaluates in place of the node; nullptr for any other node.
+    virtual FunctionAST * evaluate_callee() { return nullptr; }
+
+    // Moves the operands out, so that the tree can be freed without recursion.
+    virtual void release_operands(std::vector<std::unique_ptr<ExprAST>>&) {}
+
+    // Frees the operands and everything below them, one node at a time.
+    void destroy_operands();
 };
 
 /*!
@@ -58,7 +132,14 @@ public:
     NumberExprAST(double val)
         : val(val) {}
 
-    llvm::Value * codegen() override;
+    ExprKind get_kind() const override { return expr_number; }
+    double get_val() const noexcept { return val; }
+
+    double evaluate() override;
+
+protected:
+    llvm::Value * codegen_emit(llvm::Value * const * p_operands) override;
+    double evaluate_emit(const double * p_operands) override;
 };
 
 /*!
@@ -69,6 +150,8 @@ class VariableExprAST : public ExprAST
 private:
     // The variable name.
     std::string name;
+    // The argument index, resolved on first evaluation.
+    int slot = -1;
 
 public:
     // Ctor.
@@ -77,7 +160,14 @@ public:
     VariableExprAST(const std::string& name)
         : name(name) {}
 
-    llvm::Value * codegen() override;
+    ExprKind get_kind() const override { return expr_variable; }
+    const std::string& get_name() const noexcept { return name; }
+
+    double evaluate() override;
+
+protected:
+    llvm::Value * codegen_emit(llvm::Value * const * p_operands) override;
+    double evaluate_emit(const double * p_operands) override;
 };
 
 /*!
@@ -98,8 +188,21 @@ public:
                   std::unique_ptr<ExprAST> lhs,
                   std::unique_ptr<ExprAST> rhs)
         : op(op), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+    ~BinaryExprAST() override { destroy_operands(); }
+
+    ExprKind get_kind() const override { return expr_binary; }
+    char get_op() const noexcept { return op; }
+    std::unique_ptr<ExprAST>& get_lhs() noexcept { return lhs; }
+    std::unique_ptr<ExprAST>& get_rhs() noexcept { return rhs; }
 
-    llvm::Value * codegen() override;
+    double evaluate() override;
+    size_t num_operands() const override { return 2; }
+    ExprAST * get_operand(size_t i) const override { return i ? rhs.get() : lhs.get(); }
+
+protected:
+    llvm::Value * codegen_emit(llvm::Value * const * p_operands) override;
+    double evaluate_emit(const double * p_operands) override;
+    void release_operands(std::vector<std::unique_ptr<ExprAST>>& out) override;
 };
 
 /*!
@@ -110,13 +213,39 @@ class CallExprAST : public ExprAST
 private:
     std::string callee;
     std::vector<std::unique_ptr<ExprAST>> args;
+    // The callee, resolved on first evaluation: a FunctionAST, or, with the
+    // flag set, the slot holding a host function an extern declared. One
+    // pointer keeps the node in the allocator's size class for 72 bytes.
+    llvm::PointerIntPair<void *, 1, bool> callee_ref;
+
+    // Calls the resolved callee with the values of the arguments.
+    double evaluate_call(const double * p_vals);
 
 public:
     CallExprAST(const std::string& callee,
                 std::vector<std::unique_ptr<ExprAST>> args)
         : callee(callee), args(std::move(args)) {}
+    ~CallExprAST() override { destroy_operands(); }
 
-    llvm::Value * codegen() override;
+    ExprKind get_kind() const override { return expr_call; }
+    const std::string& get_callee() const noexcept { return callee; }
+    std::vector<std::unique_ptr<ExprAST>>& get_args() noexcept { return args; }
+
+    double evaluate() override;
+    size_t num_operands() const override { return args.size(); }
+    ExprAST * get_operand(size_t i) const override { return args[i].get(); }
+    void collect_callee(std::vector<std::string>& callees) const override;
+
+protected:
+    bool codegen_enter() override;
+    llvm::Value * codegen_emit(llvm::Value * const * p_operands) override;
+    bool evaluate_enter() override;
+    double evaluate_emit(const double * p_operands) override;
+    FunctionAST * evaluate_callee() override
+    {
+        return callee_ref.getInt() ? nullptr : (FunctionAST *) callee_ref.getPointer();
+    }
+    void release_operands(std::vector<std::unique_ptr<ExprAST>>& out) override;
 };
 
 /*!
@@ -130,13 +259,26 @@ class PrototypeAST
 private:
     std::string name;
     std::vector<std::string> args;
+    // Where the function's name, or a top-level expression, begins. Unlike
+    // the expression nodes' locations it stays in the node: there is one per
+    // item, it travels with the copies kept in g_function_protos, and with
+    // the defined flag the prototype takes the same malloc chunk either way.
+    SourceLocation loc;
+    // Whether a body was generated for it, in g_function_protos, so that it
+    // cannot be defined again in a later module.
+    bool defined = false;
 
 public:
     PrototypeAST(const std::string& name,
-                 std::vector<std::string> args)
-        : name(name), args(std::move(args)) {}
+                 std::vector<std::string> args,
+                 SourceLocation loc = SourceLocation())
+        : name(name), args(std::move(args)), loc(loc) {}
 
     const std::string& get_name() const noexcept { return name; }
+    const std::vector<std::string>& get_args() const noexcept { return args; }
+    SourceLocation get_loc() const noexcept { return loc; }
+    bool is_defined() const noexcept { return defined; }
+    void set_defined() noexcept { defined = true; }
 
     llvm::Function * codegen();
 };
@@ -155,9 +297,29 @@ public:
                 std::unique_ptr<ExprAST> body)
         : proto(std::move(proto)), body(std::move(body)) {}
 
+    const std::string& get_name() const noexcept { return proto->get_name(); }
+    const PrototypeAST& get_proto() const noexcept { return *proto; }
+    ExprAST * get_body() const noexcept { return body.get(); }
+
     llvm::Function * codegen();
+
+    // Evaluates the body by walking the tree, with one value per argument.
+    double evaluate(const double * p_args);
+
+    // The names of the functions the body calls, each once.
+    std::vector<std::string> get_callees() const;
 };
 
+/*!
+ * @brief This function looks up a function by name in the current module,
+ *          emitting a declaration from its recorded prototype if it was
+ *          defined in an earlier module.
+ *
+ * @return The function, or nullptr if no such function is known.
+ */
+llvm::Function *
+get_function (const std::string& name);
+
 /*!
  * @brief This function is a helper function for error handling.
  *
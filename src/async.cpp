@@ -0,0 +1,432 @@
+/*!
+ * @file src/async.cpp
+ *
+ * @brief This file contains the asynchronous embedding API.
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#include "async.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "parser.hpp"
+
+/*!
+ * @brief This function returns a monotonic timestamp in seconds.
+ */
+static double
+now_secs (void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * @brief This function resumes a coroutine on the executor.
+ */
+void
+RunLoop::post (std::coroutine_handle<> h)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(h);
+    }
+    ready.notify_one();
+}
+
+/*!
+ * @brief This function resumes posted coroutines until stop() is called
+ *          and none are left.
+ */
+void
+RunLoop::run (void)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        ready.wait(lock, [this] { return !queue.empty() || stopped; });
+        if (queue.empty())
+        {
+            break;
+        }
+
+        std::coroutine_handle<> h = queue.front();
+        queue.pop_front();
+
+        lock.unlock();
+        h.resume();
+        lock.lock();
+    }
+    stopped = false;
+}
+
+/*!
+ * @brief This function makes run() return once it is idle.
+ */
+void
+RunLoop::stop (void)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    ready.notify_one();
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function queues the request once its coroutine has suspended.
+ */
+void
+AsyncOp::await_suspend (std::coroutine_handle<> h)
+{
+    waiter = h;
+    p_compiler->submit(this);
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function starts the compiler's threads.
+ */
+AsyncCompiler::AsyncCompiler(unsigned threads)
+{
+    for (unsigned i = 0; i < (threads ? threads : 1); ++i)
+    {
+        workers.emplace_back(&AsyncCompiler::worker_main, this);
+    }
+}
+
+/*!
+ * @brief This function finishes the queued requests and stops the threads.
+ */
+AsyncCompiler::~AsyncCompiler()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_ready.notify_all();
+
+    for (auto& t : workers)
+    {
+        t.join();
+    }
+}
+
+/*!
+ * @brief This function appends a request to the queue.
+ */
+void
+AsyncCompiler::submit (AsyncOp * p_op)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        p_op->p_next = nullptr;
+        if (p_tail)
+        {
+            p_tail->p_next = p_op;
+        }
+        else
+        {
+            p_head = p_op;
+        }
+        p_tail = p_op;
+    }
+    queue_ready.notify_one();
+}
+
+/*!
+ * @brief This function is the body of each of the compiler's threads. It
+ *          runs requests until the compiler stops and the queue is empty.
+ */
+void
+AsyncCompiler::worker_main (void)
+{
+    install_binop_precedence();
+    bool ready = init_native_target(g_opt_level);
+    if (ready)
+    {
+        init_module("async");
+    }
+
+    for (;;)
+    {
+        AsyncOp * p_op;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_ready.wait(lock, [this] { return p_head || stopping; });
+            if (!p_head)
+            {
+                break;
+            }
+
+            p_op = p_head;
+            p_head = p_op->p_next;
+            if (!p_head)
+            {
+                p_tail = nullptr;
+            }
+        }
+
+        AsyncResult result;
+        if (ready)
+        {
+            result.ok = p_op->is_expression
+                ? run_evaluate(p_op->text, result.value)
+                : run_compile(p_op->text);
+        }
+
+        // The request lives in the waiter's frame; once posted, it may be
+        // gone.
+        p_op->result = result;
+        p_op->p_executor->post(p_op->waiter);
+    }
+
+    // Thread-local codegen state dies with the thread; the target machine
+    // must go before LLVM's own statics do.
+    lexer_reset();
+    g_target_machine.reset();
+}
+
+/*!
+ * @brief This function copies the shared prototypes of the given functions
+ *          into the calling thread's g_function_protos, so that calls to
+ *          them can be generated here. Unknown names are left for codegen
+ *          to report.
+ */
+void
+AsyncCompiler::import_protos (const std::vector<std::string>& names)
+{
+    std::lock_guard<std::mutex> lock(protos_mutex);
+
+    for (const auto& name : names)
+    {
+        auto it = protos.find(name);
+        if (it != protos.end() && !g_function_protos.count(name))
+        {
+            g_function_protos[name] = std::make_unique<PrototypeAST>(*it->second);
+        }
+    }
+}
+
+/*!
+ * @brief This function shares a prototype with the other threads.
+ */
+void
+AsyncCompiler::export_proto (const PrototypeAST& proto)
+{
+    std::lock_guard<std::mutex> lock(protos_mutex);
+    protos[proto.get_name()] = std::make_unique<PrototypeAST>(proto);
+}
+
+/*!
+ * @brief This function tells whether any thread has compiled a body for the
+ *          named function.
+ */
+bool
+AsyncCompiler::shared_defined (const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(protos_mutex);
+    auto it = protos.find(name);
+    return it != protos.end() && it->second->is_defined();
+}
+
+/*!
+ * @brief This function compiles definitions and externs into the JIT, on
+ *          the calling thread.
+ */
+bool
+AsyncCompiler::run_compile (const std::string& text)
+{
+    lexer_set_input(text.data(), text.size());
+    get_next_token();
+
+    std::vector<std::unique_ptr<PrototypeAST>> compiled;
+    bool ok = true;
+
+    // What the request replaced in g_function_protos, to put back if it
+    // fails: nothing of it may be called or block a redefinition.
+    std::vector<std::pair<std::string, std::unique_ptr<PrototypeAST>>> replaced;
+    auto remember = [&replaced](const std::string& name)
+    {
+        auto it = g_function_protos.find(name);
+        replaced.emplace_back(name, it == g_function_protos.end()
+            ? nullptr : std::make_unique<PrototypeAST>(*it->second));
+    };
+
+    // Parsing is left out of the compile time, as in the REPL.
+    double codegen_secs = 0.0;
+    bool any_def = false;
+    while (ok && cur_tok != tok_eof)
+    {
+        switch (cur_tok)
+        {
+            case ';':
+                get_next_token();
+            break;
+
+            case tok_def:
+            {
+                auto fn_ast = parse_definition();
+                if (!fn_ast)
+                {
+                    ok = false;
+                    break;
+                }
+
+                // Another thread may have compiled it already.
+                const std::string& name = fn_ast->get_name();
+                if (shared_defined(name))
+                {
+                    log_error("Function cannot be redefined");
+                    ok = false;
+                    break;
+                }
+
+                double start = now_secs();
+                std::vector<std::string> callees = fn_ast->get_callees();
+                import_protos(callees);
+                remember(name);
+                ok = fn_ast->codegen() != nullptr;
+                codegen_secs += now_secs() - start;
+                if (ok)
+                {
+                    any_def = true;
+                    jit_record_callees(name, std::move(callees));
+                    compiled.push_back(std::make_unique<PrototypeAST>(*g_function_protos[name]));
+                }
+            }
+            break;
+
+            case tok_extern:
+            {
+                auto proto_ast = parse_extern();
+                double start = now_secs();
+                ok = proto_ast && proto_ast->codegen();
+                if (ok)
+                {
+                    latency_extern_register.record(now_secs() - start);
+
+                    // Declaring a defined function again keeps it defined.
+                    const std::string& name = proto_ast->get_name();
+                    auto it = g_function_protos.find(name);
+                    if (it == g_function_protos.end() || !it->second->is_defined())
+                    {
+                        remember(name);
+                        g_function_protos[name] = std::make_unique<PrototypeAST>(*proto_ast);
+                        compiled.push_back(std::move(proto_ast));
+                    }
+                }
+            }
+            break;
+
+            default:
+                log_error("Expected a definition or an extern");
+                ok = false;
+            break;
+        }
+    }
+
+    double start = now_secs();
+    if (ok)
+    {
+        optimize_module(*g_module, g_opt_level);
+        ok = jit_add_module();
+    }
+
+    // Nothing of a failed request reaches the JIT, and its prototypes are
+    // undone, latest first.
+    if (!ok)
+    {
+        init_module("async");
+        for (auto it = replaced.rbegin(); it != replaced.rend(); ++it)
+        {
+            if (it->second)
+            {
+                g_function_protos[it->first] = std::move(it->second);
+            }
+            else
+            {
+                g_function_protos.erase(it->first);
+            }
+        }
+        return false;
+    }
+
+    // The definitions of a request compile as one module, so they are
+    // timed together.
+    if (any_def)
+    {
+        double compile = codegen_secs + (now_secs() - start);
+        metric_compile_seconds.observe(compile);
+        latency_def_compile.record(compile);
+    }
+
+    for (const auto& proto : compiled)
+    {
+        export_proto(*proto);
+    }
+    return true;
+}
+
+/*!
+ * @brief This function compiles and runs one top-level expression, on the
+ *          calling thread.
+ */
+bool
+AsyncCompiler::run_evaluate (const std::string& text, double& value)
+{
+    lexer_set_input(text.data(), text.size());
+    get_next_token();
+
+    auto fn_ast = parse_top_level_expr();
+    if (!fn_ast)
+    {
+        return false;
+    }
+
+    double start = now_secs();
+    std::vector<std::string> callees = fn_ast->get_callees();
+    import_protos(callees);
+    jit_speculate(callees);
+
+    llvm::Function * p_func = fn_ast->codegen();
+    if (!p_func)
+    {
+        init_module("async");
+        return false;
+    }
+
+    // Other threads' expressions are in the JIT at the same time.
+    std::string name = "__anon_expr.async." + std::to_string(next_expr++);
+    p_func->setName(name);
+
+    auto rt = g_jit->getMainJITDylib().createResourceTracker();
+    optimize_module(*g_module, g_opt_level);
+    if (!jit_add_module(rt))
+    {
+        return false;
+    }
+
+    void * p_fn = jit_lookup(name);
+    double compiled = now_secs();
+    bool ok = p_fn && jit_call(p_fn, nullptr, 0, value);
+    if (ok)
+    {
+        double executed = now_secs();
+        metric_compile_seconds.observe(compiled - start);
+        metric_evaluations.add();
+        metric_evaluation_seconds.observe(executed - compiled);
+        latency_expr_compile.record(compiled - start);
+        latency_expr_execute.record(executed - compiled);
+    }
+
+    return jit_remove(std::move(rt)) && ok;
+}
+
+/***   end of file   ***/
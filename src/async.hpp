@@ -0,0 +1,246 @@
+/*!
+ * @file src/async.hpp
+ *
+ * @brief This file contains the asynchronous embedding API, in which
+ *          compiling a definition or evaluating an expression is a C++20
+ *          awaitable that runs on the compiler's own threads.
+ *
+ *          This header, and whatever includes it, needs -std=c++20.
+ */
+
+#ifndef _LLVM_ASYNC_H
+#define _LLVM_ASYNC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ast.hpp"
+
+/*!
+ * @brief This class is where a coroutine resumes once its request is done:
+ *          the caller's event loop, thread pool or similar.
+ */
+class Executor
+{
+public:
+    virtual ~Executor() = default;
+
+    /*!
+     * @brief This function resumes a coroutine on the executor. It is called
+     *          from the compiler's threads.
+     */
+    virtual void
+    post (std::coroutine_handle<> h) = 0;
+};
+
+/*!
+ * @brief This class is a minimal executor that resumes coroutines one at a
+ *          time on the thread that calls run().
+ */
+class RunLoop : public Executor
+{
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::coroutine_handle<>> queue;
+    bool stopped = false;
+
+public:
+    void
+    post (std::coroutine_handle<> h) override;
+
+    /*!
+     * @brief This function resumes posted coroutines until stop() is called
+     *          and none are left.
+     */
+    void
+    run (void);
+
+    /*!
+     * @brief This function makes run() return once it is idle. It may be
+     *          called from a coroutine run() is resuming.
+     */
+    void
+    stop (void);
+};
+
+/*!
+ * @brief This struct is the return type of a coroutine that starts when it
+ *          is called and frees itself when it finishes, for callers that
+ *          track completion themselves.
+ */
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object (void) { return {}; }
+        std::suspend_never initial_suspend (void) noexcept { return {}; }
+        std::suspend_never final_suspend (void) noexcept { return {}; }
+        void return_void (void) {}
+        void unhandled_exception (void) { std::abort(); }
+    };
+};
+
+/*!
+ * @brief This struct holds the outcome of a request.
+ */
+struct AsyncResult
+{
+    bool ok = false;        // False if it failed to parse or compile.
+    double value = 0.0;     // The value of an evaluated expression.
+};
+
+class AsyncCompiler;
+
+/*!
+ * @brief This class is one request, to be co_await'ed where it is made.
+ *
+ *          The request lives in the awaiting coroutine's frame and is
+ *              queued by an intrusive link, so one in flight costs its
+ *              source text and nothing else.
+ */
+class AsyncOp
+{
+    friend class AsyncCompiler;
+
+private:
+    AsyncCompiler * p_compiler;
+    Executor * p_executor;
+    bool is_expression;
+    std::string text;
+    std::coroutine_handle<> waiter;
+    AsyncOp * p_next = nullptr;
+    AsyncResult result;
+
+public:
+    // Ctor.
+    AsyncOp(AsyncCompiler * p_compiler,
+            Executor * p_executor,
+            bool is_expression,
+            std::string text)
+        : p_compiler(p_compiler), p_executor(p_executor),
+          is_expression(is_expression), text(std::move(text)) {}
+
+    AsyncOp(const AsyncOp&) = delete;
+    AsyncOp& operator=(const AsyncOp&) = delete;
+
+    bool await_ready (void) const noexcept { return false; }
+
+    void
+    await_suspend (std::coroutine_handle<> h);
+
+    AsyncResult await_resume (void) { return result; }
+};
+
+/*!
+ * @brief This class compiles and evaluates source on a pool of threads,
+ *          for callers that cannot block on the LLVM pipeline.
+ *
+ *          Each thread parses, generates and optimizes IR with its own
+ *              LLVM context, then hands the module to g_jit, whose compile
+ *              threads generate the machine code. The prototypes of
+ *              everything compiled are shared, so an expression on one
+ *              thread can call a definition compiled on another. Requests
+ *              run in parallel; a caller that needs a definition first
+ *              awaits its compile().
+ *
+ *          g_jit must be created before, and destroyed after, the
+ *              compiler, with at least one compile thread: without them
+ *              it generates code with a single target machine, which
+ *              cannot be shared between threads.
+ */
+class AsyncCompiler
+{
+    friend class AsyncOp;
+
+private:
+    std::vector<std::thread> workers;
+
+    // The queue of requests, linked through AsyncOp::p_next.
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    AsyncOp * p_head = nullptr;
+    AsyncOp * p_tail = nullptr;
+    bool stopping = false;
+
+    // The prototype of every definition and extern compiled so far.
+    std::mutex protos_mutex;
+    std::map<std::string, std::unique_ptr<PrototypeAST>> protos;
+
+    // Numbers the expressions, which share the JIT while they run.
+    std::atomic<unsigned> next_expr{ 0 };
+
+    void
+    submit (AsyncOp * p_op);
+
+    void
+    worker_main (void);
+
+    void
+    import_protos (const std::vector<std::string>& names);
+
+    void
+    export_proto (const PrototypeAST& proto);
+
+    bool
+    shared_defined (const std::string& name);
+
+    bool
+    run_compile (const std::string& text);
+
+    bool
+    run_evaluate (const std::string& text, double& value);
+
+public:
+    /*!
+     * @brief This function starts the compiler's threads.
+     *
+     * @param threads The number of threads, at least one.
+     */
+    AsyncCompiler(unsigned threads);
+
+    /*!
+     * @brief This function finishes the queued requests and stops the
+     *          threads.
+     */
+    ~AsyncCompiler();
+
+    /*!
+     * @brief This function makes a request to compile definitions and
+     *          externs into the JIT.
+     *
+     * @param source Any number of "def" and "extern" items.
+     * @param executor Where the awaiting coroutine resumes.
+     */
+    AsyncOp
+    compile (std::string source, Executor& executor)
+    {
+        return AsyncOp(this, &executor, false, std::move(source));
+    }
+
+    /*!
+     * @brief This function makes a request to compile and run one top-level
+     *          expression, whose value is the result's value.
+     *
+     * @param expr The expression.
+     * @param executor Where the awaiting coroutine resumes.
+     */
+    AsyncOp
+    evaluate (std::string expr, Executor& executor)
+    {
+        return AsyncOp(this, &executor, true, std::move(expr));
+    }
+};
+
+#endif // _LLVM_ASYNC_H
+
+/***   end of file   ***/
@@ -0,0 +1,633 @@
+/*!
+ * @file src/batch.cpp
+ *
+ * @brief This file contains batch compilation of whole source files to
+ *          object files, optionally on several threads.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "batch.hpp"
+#include "compiler.hpp"
+#include "parser.hpp"
+
+/*!
+ * @brief This function returns a monotonic timestamp in seconds.
+ */
+static double
+now_secs (void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * @brief This function compiles a source buffer to an object file on the
+ *          calling thread.
+ */
+bool
+compile_source (const std::string& name,
+                const std::string& text,
+                llvm::SmallVectorImpl<char>& object,
+                std::vector<std::string> * p_entries,
+                unsigned unit)
+{
+    if (!g_target_machine && !init_native_target(g_opt_level))
+    {
+        return false;
+    }
+
+    // Nothing of the units this thread compiled before may show through.
+    init_module(name);
+    g_function_protos.clear();
+    g_deferred_functions.clear();
+    g_named_values.clear();
+    g_aot_entries.clear();
+    install_binop_precedence();
+
+    lexer_set_input(text.data(), text.size());
+    get_next_token();
+
+    bool ok = true;
+    while (ok && cur_tok != tok_eof)
+    {
+        switch (cur_tok)
+        {
+            case ';':
+                get_next_token();
+            break;
+
+            case tok_def:
+            {
+                auto fn_ast = parse_definition();
+                ok = fn_ast && fn_ast->codegen();
+            }
+            break;
+
+            case tok_extern:
+            {
+                auto proto_ast = parse_extern();
+                ok = proto_ast && proto_ast->codegen();
+                if (ok)
+                {
+                    g_function_protos[proto_ast->get_name()] = std::move(proto_ast);
+                }
+            }
+            break;
+
+            default:
+            {
+                auto fn_ast = parse_top_level_expr();
+                llvm::Function * p_func = fn_ast ? fn_ast->codegen() : nullptr;
+                ok = p_func != nullptr;
+                if (ok)
+                {
+                    p_func->setName("__anon_expr." + (p_entries ? std::to_string(unit) + "." : "")
+                                    + std::to_string(g_aot_entries.size()));
+                    g_aot_entries.push_back(p_func->getName().str());
+                }
+            }
+            break;
+        }
+    }
+
+    lexer_reset();
+    if (!ok)
+    {
+        fprintf(stderr, "Error: failed to compile %s\n", name.c_str());
+        return false;
+    }
+
+    if (p_entries)
+    {
+        p_entries->insert(p_entries->end(), g_aot_entries.begin(), g_aot_entries.end());
+    }
+    else if (!g_aot_entries.empty())
+    {
+        add_aot_main();
+    }
+    optimize_module(*g_module, g_opt_level);
+    bool emitted = emit_object(*g_module, object);
+
+    g_module.reset();
+    return emitted;
+}
+
+/*!
+ * @brief This function reads a whole source file.
+ */
+static bool
+read_source (const std::string& path, std::string& text)
+{
+    FILE * p_file = fopen(path.c_str(), "rb");
+    if (!p_file)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p_file)) > 0)
+    {
+        text.append(buf, n);
+    }
+    fclose(p_file);
+
+    return true;
+}
+
+/*!
+ * @brief This function reads a file, compiles it, and either writes
+ *          "<file>.o" or stores the bytes.
+ */
+static bool
+compile_one (const std::string& path, llvm::SmallVector<char, 0> * p_store)
+{
+    std::string text;
+    if (!read_source(path, text))
+    {
+        return false;
+    }
+
+    llvm::SmallVector<char, 0> object;
+    if (!compile_source(path, text, object))
+    {
+        return false;
+    }
+
+    if (p_store)
+    {
+        *p_store = std::move(object);
+        return true;
+    }
+
+    std::string out = path + ".o";
+    FILE * p_file = fopen(out.c_str(), "wb");
+    bool ok = p_file && fwrite(object.data(), 1, object.size(), p_file) == object.size();
+    if (p_file)
+    {
+        fclose(p_file);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", out.c_str());
+    }
+
+    return ok;
+}
+
+/*!
+ * @brief This function compiles each file to "<file>.o" with the given
+ *          number of worker threads.
+ */
+bool
+compile_files (const std::vector<std::string>& paths,
+               unsigned jobs,
+               BatchStats& stats,
+               std::vector<llvm::SmallVector<char, 0>> * p_objects)
+{
+    if (0 == jobs)
+    {
+        jobs = 1;
+    }
+    if (p_objects)
+    {
+        p_objects->clear();
+        p_objects->resize(paths.size());
+    }
+
+    // Registers the target before any worker needs it.
+    if (!init_native_target(g_opt_level))
+    {
+        return false;
+    }
+
+    // Workers pull the next file index from a shared queue.
+    std::mutex queue_lock;
+    size_t next = 0;
+    bool all_ok = true;
+
+    stats = BatchStats();
+    stats.busy.assign(jobs, 0.0);
+    std::vector<double> waits(jobs, 0.0);
+
+    auto worker = [&](unsigned id) {
+        for (;;)
+        {
+            double start = now_secs();
+            size_t index;
+            {
+                std::lock_guard<std::mutex> guard(queue_lock);
+                index = next++;
+            }
+            waits[id] += now_secs() - start;
+
+            if (index >= paths.size())
+            {
+                break;
+            }
+
+            start = now_secs();
+            bool ok = compile_one(paths[index], p_objects ? &(*p_objects)[index] : nullptr);
+            stats.busy[id] += now_secs() - start;
+
+            if (!ok)
+            {
+                std::lock_guard<std::mutex> guard(queue_lock);
+                all_ok = false;
+            }
+        }
+
+        // Thread-local codegen state dies with the thread; the target
+        // machine must go before LLVM's own statics do.
+        g_target_machine.reset();
+    };
+
+    double start = now_secs();
+    if (1 == jobs)
+    {
+        worker(0);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        for (unsigned id = 0; id < jobs; ++id)
+        {
+            threads.emplace_back(worker, id);
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+    }
+    stats.wall = now_secs() - start;
+
+    for (double w : waits)
+    {
+        stats.queue_wait += w;
+    }
+
+    return all_ok;
+}
+
+// Each worker process owns one slice of the shared arena. It is reserved,
+// not committed, so only what the objects use costs memory.
+static const size_t arena_slice = (size_t) 256 << 20;
+
+/*!
+ * @brief This struct is a worker's reply for one file. The object bytes,
+ *          then the NUL-terminated entry names, sit in the arena.
+ */
+struct WorkerReply
+{
+    uint32_t index;
+    uint32_t ok;
+    uint64_t offset;
+    uint64_t object_size;
+    uint64_t entries_size;
+    double busy;
+    double wait;
+};
+
+/*!
+ * @brief This function reads exactly n bytes from a pipe.
+ *
+ * @return False on end of file or error.
+ */
+static bool
+read_full (int fd, void * p_buf, size_t n)
+{
+    char * p = (char *) p_buf;
+    while (n > 0)
+    {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        p += got;
+        n -= got;
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function writes exactly n bytes to a pipe.
+ */
+static bool
+write_full (int fd, const void * p_buf, size_t n)
+{
+    const char * p = (const char *) p_buf;
+    while (n > 0)
+    {
+        ssize_t put = write(fd, p, n);
+        if (put < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        if (put <= 0)
+        {
+            return false;
+        }
+        p += put;
+        n -= put;
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function is the body of a worker process: it compiles the
+ *          files whose indices arrive on cmd_fd until the pipe closes.
+ *
+ * @param p_arena The whole arena.
+ * @param base The offset of this worker's slice.
+ */
+static void
+worker_main (const std::vector<std::string>& paths,
+             int cmd_fd,
+             int reply_fd,
+             char * p_arena,
+             size_t base)
+{
+    size_t used = 0;
+    for (;;)
+    {
+        double start = now_secs();
+        uint32_t index;
+        if (!read_full(cmd_fd, &index, sizeof(index)))
+        {
+            break;
+        }
+
+        WorkerReply reply = {};
+        reply.index = index;
+        reply.wait = now_secs() - start;
+        start = now_secs();
+
+        std::string text;
+        llvm::SmallVector<char, 0> object;
+        std::vector<std::string> entries;
+        bool ok = read_source(paths[index], text)
+            && compile_source(paths[index], text, object, &entries, index);
+
+        size_t names = 0;
+        for (const auto& entry : entries)
+        {
+            names += entry.size() + 1;
+        }
+        if (ok && used + object.size() + names > arena_slice)
+        {
+            fprintf(stderr, "Error: no room in the arena for %s\n", paths[index].c_str());
+            ok = false;
+        }
+
+        if (ok)
+        {
+            char * p = p_arena + base + used;
+            memcpy(p, object.data(), object.size());
+            p += object.size();
+            for (const auto& entry : entries)
+            {
+                memcpy(p, entry.c_str(), entry.size() + 1);
+                p += entry.size() + 1;
+            }
+
+            reply.offset = base + used;
+            reply.object_size = object.size();
+            reply.entries_size = names;
+            used = (used + object.size() + names + 15) & ~(size_t) 15;
+        }
+
+        reply.ok = ok;
+        reply.busy = now_secs() - start;
+        if (!write_full(reply_fd, &reply, sizeof(reply)))
+        {
+            break;
+        }
+    }
+}
+
+/*!
+ * @brief This function compiles the files in the given number of forked
+ *          worker processes and links them into one executable.
+ */
+bool
+link_files (const std::vector<std::string>& paths,
+            unsigned procs,
+            const std::string& out,
+            BatchStats& stats)
+{
+    if (0 == procs)
+    {
+        procs = 1;
+    }
+    if (procs > paths.size() && !paths.empty())
+    {
+        procs = paths.size();
+    }
+
+    stats = BatchStats();
+    stats.busy.assign(procs, 0.0);
+
+    char * p_arena = (char *) mmap(nullptr, procs * arena_slice, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == p_arena)
+    {
+        fprintf(stderr, "Error: cannot map the object arena: %s\n", strerror(errno));
+        return false;
+    }
+
+    // A worker that dies shows up as a closed pipe, not as SIGPIPE here.
+    signal(SIGPIPE, SIG_IGN);
+
+    double start = now_secs();
+    std::vector<pid_t> pids;
+    std::vector<int> cmd_fds;
+    std::vector<int> reply_fds;
+    for (unsigned id = 0; id < procs; ++id)
+    {
+        int cmd[2], reply[2];
+        if (0 != pipe2(cmd, O_CLOEXEC) || 0 != pipe2(reply, O_CLOEXEC))
+        {
+            fprintf(stderr, "Error: pipe: %s\n", strerror(errno));
+            break;
+        }
+
+        pid_t pid = fork();
+        if (0 == pid)
+        {
+            // Drop the parent's ends of the earlier workers' pipes, or
+            // those workers would never see their command pipe close.
+            for (int fd : cmd_fds)
+            {
+                close(fd);
+            }
+            for (int fd : reply_fds)
+            {
+                close(fd);
+            }
+            close(cmd[1]);
+            close(reply[0]);
+
+            worker_main(paths, cmd[0], reply[1], p_arena, id * arena_slice);
+            _exit(0);
+        }
+        close(cmd[0]);
+        close(reply[1]);
+        if (pid < 0)
+        {
+            fprintf(stderr, "Error: fork: %s\n", strerror(errno));
+            close(cmd[1]);
+            close(reply[0]);
+            break;
+        }
+
+        pids.push_back(pid);
+        cmd_fds.push_back(cmd[1]);
+        reply_fds.push_back(reply[0]);
+    }
+
+    // Hand out one file at a time, to whichever worker replies first.
+    std::vector<WorkerReply> replies(paths.size());
+    bool all_ok = !pids.empty();
+    size_t next = 0;
+    size_t in_flight = 0;
+
+    auto dispatch = [&](size_t id) {
+        uint32_t index = next;
+        if (next < paths.size() && write_full(cmd_fds[id], &index, sizeof(index)))
+        {
+            ++next;
+            ++in_flight;
+            return;
+        }
+        close(cmd_fds[id]);
+        cmd_fds[id] = -1;
+    };
+
+    for (size_t id = 0; id < pids.size(); ++id)
+    {
+        dispatch(id);
+    }
+
+    std::vector<struct pollfd> polls(pids.size());
+    while (in_flight > 0)
+    {
+        for (size_t id = 0; id < pids.size(); ++id)
+        {
+            polls[id].fd = cmd_fds[id] >= 0 ? reply_fds[id] : -1;
+            polls[id].events = POLLIN;
+            polls[id].revents = 0;
+        }
+        if (poll(polls.data(), polls.size(), -1) < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            fprintf(stderr, "Error: poll: %s\n", strerror(errno));
+            all_ok = false;
+            break;
+        }
+
+        for (size_t id = 0; id < pids.size(); ++id)
+        {
+            if (!polls[id].revents)
+            {
+                continue;
+            }
+            --in_flight;
+
+            WorkerReply reply;
+            if (!read_full(reply_fds[id], &reply, sizeof(reply)) || reply.index >= paths.size())
+            {
+                fprintf(stderr, "Error: compile worker %zu died\n", id);
+                all_ok = false;
+                close(cmd_fds[id]);
+                cmd_fds[id] = -1;
+                continue;
+            }
+
+            replies[reply.index] = reply;
+            stats.busy[id] += reply.busy;
+            stats.queue_wait += reply.wait;
+            all_ok = all_ok && reply.ok;
+
+            dispatch(id);
+        }
+    }
+
+    for (size_t id = 0; id < pids.size(); ++id)
+    {
+        if (cmd_fds[id] >= 0)
+        {
+            close(cmd_fds[id]);
+        }
+        close(reply_fds[id]);
+        waitpid(pids[id], nullptr, 0);
+    }
+    stats.wall = now_secs() - start;
+
+    // Every worker may have died before the last file went out.
+    all_ok = all_ok && next == paths.size();
+
+    // Link straight from the arena, with a main calling every entry.
+    start = now_secs();
+    if (all_ok)
+    {
+        std::vector<llvm::StringRef> objects;
+        std::vector<std::string> entries;
+        for (const auto& reply : replies)
+        {
+            const char * p = p_arena + reply.offset;
+            objects.emplace_back(p, reply.object_size);
+
+            const char * p_end = p + reply.object_size + reply.entries_size;
+            for (p += reply.object_size; p < p_end; p += strlen(p) + 1)
+            {
+                entries.push_back(p);
+            }
+        }
+
+        llvm::SmallVector<char, 0> main_object;
+        all_ok = init_native_target(g_opt_level);
+        if (all_ok)
+        {
+            init_module("main");
+            g_aot_entries = entries;
+            add_aot_main();
+            all_ok = emit_object(*g_module, main_object);
+            g_module.reset();
+        }
+        if (all_ok)
+        {
+            objects.emplace_back(main_object.data(), main_object.size());
+            all_ok = link_objects(objects, out, false);
+        }
+    }
+    stats.link = now_secs() - start;
+
+    munmap(p_arena, procs * arena_slice);
+
+    return all_ok;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,84 @@
+/*!
+ * @file src/batch.hpp
+ *
+ * @brief This file contains batch compilation of whole source files to
+ *          object files, optionally on several threads.
+ */
+
+#ifndef _LLVM_BATCH_H
+#define _LLVM_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+
+/*!
+ * @brief This struct holds how a batch compile spent its time, in seconds.
+ */
+struct BatchStats
+{
+    double wall = 0.0;
+    double queue_wait = 0.0;        // Summed over workers.
+    std::vector<double> busy;       // Time compiling, per worker.
+    double link = 0.0;              // Time linking, when linking.
+};
+
+/*!
+ * @brief This function compiles a source buffer to an object file on the
+ *          calling thread, as an AOT build would: definitions and externs
+ *          as written, and a "main" printing the top-level expressions if
+ *          there are any.
+ *
+ * @param name The module identifier, normally the source path.
+ * @param object Receives the object file bytes.
+ * @param p_entries If not null, no "main" is added; the top-level
+ *                      expressions get names unique to this unit and are
+ *                      appended here, for a main built at link time.
+ * @param unit The unit number that makes those names unique.
+ *
+ * @return True on success.
+ */
+bool
+compile_source (const std::string& name,
+                const std::string& text,
+                llvm::SmallVectorImpl<char>& object,
+                std::vector<std::string> * p_entries = nullptr,
+                unsigned unit = 0);
+
+/*!
+ * @brief This function compiles each file to "<file>.o" with the given
+ *          number of worker threads. Each worker has its own LLVMContext.
+ *
+ * @param p_objects If not null, receives each object's bytes in input
+ *                      order, and no files are written.
+ *
+ * @return True if every file compiled.
+ */
+bool
+compile_files (const std::vector<std::string>& paths,
+               unsigned jobs,
+               BatchStats& stats,
+               std::vector<llvm::SmallVector<char, 0>> * p_objects = nullptr);
+
+/*!
+ * @brief This function compiles the files in the given number of forked
+ *          worker processes and links them into one executable, whose
+ *          "main" prints every top-level expression in file order.
+ *
+ *          Workers return their object code through a shared memory arena;
+ *              only file indices and arena offsets cross the pipes.
+ *
+ * @param out The path of the executable to write.
+ *
+ * @return True if every file compiled and the link succeeded.
+ */
+bool
+link_files (const std::vector<std::string>& paths,
+            unsigned procs,
+            const std::string& out,
+            BatchStats& stats);
+
+#endif // _LLVM_BATCH_H
+
+/***   end of file   ***/
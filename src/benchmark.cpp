@@ -0,0 +1,201 @@
+/*!
+ * @file src/benchmark.cpp
+ *
+ * @brief This file contains the benchmarking mode, which times each
+ *          top-level expression over many runs of its compiled code.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <sched.h>
+
+#include "benchmark.hpp"
+#include "jit.hpp"
+
+unsigned g_bench_runs = 0;
+
+// The time each timed sample aims for, in seconds: long enough that reading
+// the clock is lost in it.
+static const double sample_secs = 10e-6;
+
+// The most time spent warming up, in seconds.
+static const double max_warmup_secs = 0.1;
+
+/*!
+ * @brief This function returns a monotonic timestamp in seconds.
+ */
+static double
+now_secs (void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * @brief This function is a compiler barrier on a result: the compiler must
+ *          assume it is read, so it can neither drop the call that produced
+ *          it nor move the call out of the timed loop.
+ */
+static inline void
+keep_result (double& result)
+{
+    asm volatile("" : "+m"(result) : : "memory");
+}
+
+/*!
+ * @brief This function pins the calling thread to one CPU.
+ */
+bool
+bench_pin_cpu (int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        fprintf(stderr, "Error: There is no CPU %d\n", cpu);
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (0 != sched_setaffinity(0, sizeof(set), &set))
+    {
+        fprintf(stderr, "Error: Cannot pin to CPU %d: %s\n", cpu, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * @brief This function times g_bench_runs calls and prints their ns per
+ *          call.
+ *
+ *          The warmup runs a tenth as many calls, up to max_warmup_secs,
+ *              and measures how long one takes. The timed calls are then
+ *              grouped into samples of about sample_secs each, and the
+ *              statistics are over the samples' ns per call.
+ *
+ * @param call Makes one call, storing its result; returns false if it fails.
+ */
+template <typename Call>
+static bool
+measure (Call call)
+{
+    unsigned runs = g_bench_runs;
+    double result = 0.0;
+
+    unsigned warm = 0;
+    double start = now_secs();
+    double elapsed = 0.0;
+    do
+    {
+        if (!call(result))
+        {
+            return false;
+        }
+        keep_result(result);
+        ++warm;
+        elapsed = now_secs() - start;
+    }
+    while (warm <= runs / 10 && elapsed < max_warmup_secs);
+
+    double per_call = elapsed / warm;
+    unsigned batch = runs;
+    if (per_call > 0.0 && sample_secs / per_call < runs)
+    {
+        batch = std::max((unsigned) std::ceil(sample_secs / per_call), 1u);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(runs / batch + 1);
+    for (unsigned done = 0; done < runs; )
+    {
+        unsigned n = std::min(batch, runs - done);
+        double t0 = now_secs();
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (!call(result))
+            {
+                return false;
+            }
+            keep_result(result);
+        }
+        samples.push_back((now_secs() - t0) * 1e9 / n);
+        done += n;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t mid = samples.size() / 2;
+    double median = samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2.0;
+
+    double mean = 0.0;
+    for (double s : samples)
+    {
+        mean += s;
+    }
+    mean /= samples.size();
+
+    double var = 0.0;
+    for (double s : samples)
+    {
+        var += (s - mean) * (s - mean);
+    }
+    double stddev = samples.size() > 1 ? std::sqrt(var / (samples.size() - 1)) : 0.0;
+
+    fprintf(stderr, "Benchmarked %u runs in %zu samples: %.2f ns/op median, %.2f min, %.2f stddev\n",
+            runs, samples.size(), median, samples.front(), stddev);
+    return true;
+}
+
+/*!
+ * @brief This function warns if a function's body is a lone return of a
+ *          constant.
+ */
+bool
+bench_warn_folded (const llvm::Function& fn)
+{
+    const llvm::BasicBlock& entry = fn.getEntryBlock();
+    auto p_ret = llvm::dyn_cast<llvm::ReturnInst>(entry.getTerminator());
+    if (fn.size() != 1 || entry.size() != 1 || !p_ret
+        || !llvm::isa_and_nonnull<llvm::Constant>(p_ret->getReturnValue()))
+    {
+        return false;
+    }
+
+    fprintf(stderr, "Warning: The expression was folded to a constant, so only the call is timed\n");
+    return true;
+}
+
+/*!
+ * @brief This function times calls of a JIT'd top-level expression. In
+ *          process it is called directly; otherwise each call is a round
+ *          trip to the executor, and is timed as such.
+ */
+bool
+bench_compiled (void * p_fn)
+{
+    if (jit_in_process())
+    {
+        double (*p_call)(void) = (double (*)(void)) p_fn;
+        return measure([p_call](double& result) { result = p_call(); return true; });
+    }
+
+    return measure([p_fn](double& result) { return jit_call(p_fn, nullptr, 0, result); });
+}
+
+/*!
+ * @brief This function times evaluations of a top-level expression by the
+ *          tree-walking evaluator.
+ */
+void
+bench_evaluated (FunctionAST& fn)
+{
+    measure([&fn](double& result) { result = fn.evaluate(nullptr); return true; });
+}
+
+/***   end of file   ***/
@@ -0,0 +1,58 @@
+/*!
+ * @file src/benchmark.hpp
+ *
+ * @brief This file contains the benchmarking mode, which times each
+ *          top-level expression over many runs of its compiled code.
+ */
+
+#ifndef _LLVM_BENCHMARK_H
+#define _LLVM_BENCHMARK_H
+
+#include "ast.hpp"
+
+// The timed runs of each top-level expression, or 0 to run it just once.
+extern unsigned g_bench_runs;
+
+/*!
+ * @brief This function pins the calling thread to one CPU, so that the
+ *          runs are not migrated between cores while they are timed.
+ *
+ * @return False if the CPU does not exist or cannot be used.
+ */
+bool
+bench_pin_cpu (int cpu);
+
+/*!
+ * @brief This function warns if an optimized top-level expression only
+ *          returns a constant: its inputs were folded at compile time, so
+ *          timing it measures just the call.
+ *
+ * @param fn The expression's function, after optimization.
+ *
+ * @return True if it warned.
+ */
+bool
+bench_warn_folded (const llvm::Function& fn);
+
+/*!
+ * @brief This function times g_bench_runs calls of a JIT'd top-level
+ *          expression, after a warmup, and prints the ns per call.
+ *
+ * @param p_fn The address returned by jit_lookup().
+ *
+ * @return False if a call fails.
+ */
+bool
+bench_compiled (void * p_fn);
+
+/*!
+ * @brief This function times g_bench_runs evaluations of a top-level
+ *          expression by the tree-walking evaluator, after a warmup, and
+ *          prints the ns per evaluation.
+ */
+void
+bench_evaluated (FunctionAST& fn);
+
+#endif // _LLVM_BENCHMARK_H
+
+/***   end of file   ***/
@@ -0,0 +1,407 @@
+/*!
+ * @file src/compiler.cpp
+ *
+ * @brief This file contains the optimization and object emission stages
+ *          that run after codegen.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+
+#include "compiler.hpp"
+
+#include "ast.hpp"
+#include "debuginfo.hpp"
+#include "remarks.hpp"
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/DeadArgumentElimination.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#include "llvm/Transforms/IPO/GlobalOpt.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/IPO/SCCP.h"
+
+thread_local std::unique_ptr<llvm::TargetMachine> g_target_machine;
+
+// The optimization level the driver compiles at.
+int g_opt_level = 2;
+
+// The engine the driver executes with.
+Engine g_engine = engine_jit;
+
+// Whether definitions wait in g_deferred_functions until they are reached.
+bool g_demand_codegen = false;
+
+thread_local std::vector<std::string> g_aot_entries;
+
+/*!
+ * @brief This function maps a numeric level onto LLVM's codegen level.
+ */
+static llvm::CodeGenOpt::Level
+codegen_opt_level (int opt_level)
+{
+    switch (opt_level)
+    {
+        case 0:
+            return llvm::CodeGenOpt::None;
+        case 1:
+            return llvm::CodeGenOpt::Less;
+        case 3:
+            return llvm::CodeGenOpt::Aggressive;
+        default:
+            return llvm::CodeGenOpt::Default;
+    }
+}
+
+/*!
+ * @brief This function initializes the native target and creates the
+ *          calling thread's target machine used for emission.
+ */
+bool
+init_native_target (int opt_level)
+{
+    // Registering the target is process-wide, and must happen only once.
+    static std::once_flag once;
+    std::call_once(once, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target * p_target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!p_target)
+    {
+        fprintf(stderr, "Error: %s\n", error.c_str());
+        return false;
+    }
+
+    llvm::TargetOptions opts;
+    g_target_machine.reset(p_target->createTargetMachine(
+        triple,
+        llvm::sys::getHostCPUName(),
+        "",
+        opts,
+        llvm::Reloc::PIC_,
+        llvm::None,
+        codegen_opt_level(opt_level)
+    ));
+
+    return g_target_machine != nullptr;
+}
+
+/*!
+ * @brief This function creates a fresh g_context, g_builder and g_module,
+ *          the module configured for the native target.
+ */
+void
+init_module (const std::string& name)
+{
+    // The module must go before the context that owns its types, and its
+    // debug info before the module.
+    debug_reset();
+    g_module.reset();
+    g_builder.reset();
+
+    g_context = std::make_unique<llvm::LLVMContext>();
+    g_builder = std::make_unique<llvm::IRBuilder<>>(*g_context);
+    g_builder->setFastMathFlags(g_fp_flags);
+    g_module = std::make_unique<llvm::Module>(name, *g_context);
+    if (g_remarks)
+    {
+        remarks_attach(*g_context);
+    }
+    if (g_debug_info)
+    {
+        debug_init_module(*g_module, name);
+    }
+    if (g_target_machine)
+    {
+        g_module->setDataLayout(g_target_machine->createDataLayout());
+        g_module->setTargetTriple(g_target_machine->getTargetTriple().str());
+    }
+}
+
+/*!
+ * @brief This function runs a module pipeline built by the caller, with
+ *          the analyses registered for the target machine.
+ */
+static void
+run_pipeline (llvm::Module& module,
+              const std::function<llvm::ModulePassManager(llvm::PassBuilder&)>& build)
+{
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+
+    llvm::PassBuilder pb(g_target_machine.get());
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager mpm = build(pb);
+    mpm.run(module, mam);
+}
+
+/*!
+ * @brief This function runs the standard LLVM pipeline for an
+ *          optimization level over a module.
+ */
+void
+optimize_module (llvm::Module& module, int opt_level)
+{
+    // Every module is optimized before it is emitted or JIT'd, so its debug
+    // info is complete by now.
+    debug_finalize_module(module);
+
+    run_pipeline(module, [opt_level](llvm::PassBuilder& pb)
+    {
+        switch (opt_level)
+        {
+            case 0:
+                return pb.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+            case 1:
+                return pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1);
+            case 3:
+                return pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+            default:
+                return pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+        }
+    });
+}
+
+/*!
+ * @brief This function turns a complete program into a closed world: every
+ *          definition but main and the exports becomes internal, those not
+ *          address-taken switch to the fast calling convention, and the
+ *          interprocedural passes then drop or specialize what they can.
+ */
+void
+internalize_module (llvm::Module& module, const std::vector<std::string>& exports)
+{
+    std::set<std::string> keep(exports.begin(), exports.end());
+    keep.insert("main");
+
+    llvm::internalizeModule(module, [&keep](const llvm::GlobalValue& gv)
+    {
+        return keep.count(gv.getName().str()) > 0;
+    });
+
+    for (llvm::Function& fn : module)
+    {
+        if (fn.isDeclaration() || !fn.hasLocalLinkage() || fn.hasAddressTaken())
+        {
+            continue;
+        }
+        fn.setCallingConv(llvm::CallingConv::Fast);
+        for (llvm::User * p_user : fn.users())
+        {
+            if (auto * p_call = llvm::dyn_cast<llvm::CallBase>(p_user))
+            {
+                p_call->setCallingConv(llvm::CallingConv::Fast);
+            }
+        }
+    }
+
+    run_pipeline(module, [](llvm::PassBuilder&)
+    {
+        llvm::ModulePassManager mpm;
+        mpm.addPass(llvm::GlobalDCEPass());
+        mpm.addPass(llvm::IPSCCPPass());
+        mpm.addPass(llvm::DeadArgumentEliminationPass());
+        mpm.addPass(llvm::GlobalOptPass());
+        mpm.addPass(llvm::GlobalDCEPass());
+        return mpm;
+    });
+}
+
+/*!
+ * @brief This function emits a module as a native object file.
+ */
+bool
+emit_object (llvm::Module& module, llvm::SmallVectorImpl<char>& out)
+{
+    if (!g_target_machine)
+    {
+        fprintf(stderr, "Error: No target machine\n");
+        return false;
+    }
+
+    llvm::raw_svector_ostream os(out);
+    llvm::legacy::PassManager pm;
+    if (g_target_machine->addPassesToEmitFile(pm, os, nullptr, llvm::CGFT_ObjectFile))
+    {
+        fprintf(stderr, "Error: Target cannot emit an object file\n");
+        return false;
+    }
+
+    pm.run(module);
+    return true;
+}
+
+/*!
+ * @brief This function adds a "main" to g_module that calls each function
+ *          in g_aot_entries in order and prints its result.
+ */
+void
+add_aot_main (void)
+{
+    llvm::Type * p_i32 = llvm::Type::getInt32Ty(*g_context);
+
+    llvm::FunctionCallee printf_fn = g_module->getOrInsertFunction(
+        "printf",
+        llvm::FunctionType::get(p_i32, { llvm::Type::getInt8PtrTy(*g_context) }, true)
+    );
+
+    llvm::Function * p_main = llvm::Function::Create(
+        llvm::FunctionType::get(p_i32, false),
+        llvm::Function::ExternalLinkage,
+        "main",
+        g_module.get()
+    );
+    g_builder->SetInsertPoint(llvm::BasicBlock::Create(*g_context, "entry", p_main));
+    if (g_debug_info)
+    {
+        debug_begin_function(*p_main, SourceLocation());
+    }
+
+    llvm::Value * p_fmt = g_builder->CreateGlobalStringPtr("%f\n", "fmt");
+    for (const auto& name : g_aot_entries)
+    {
+        llvm::FunctionCallee p_entry = g_module->getOrInsertFunction(
+            name, llvm::Type::getDoubleTy(*g_context)
+        );
+        llvm::Value * p_result = g_builder->CreateCall(p_entry, {}, "result");
+        g_builder->CreateCall(printf_fn, { p_fmt, p_result });
+    }
+
+    g_builder->CreateRet(llvm::ConstantInt::get(p_i32, 0));
+    debug_end_function();
+    llvm::verifyFunction(*p_main);
+}
+
+/*!
+ * @brief This function runs a command, without a shell, and waits for it.
+ *
+ * @return True if it exited with status 0.
+ */
+static bool
+run_command (const std::vector<std::string>& args)
+{
+    std::vector<char *> argv;
+    for (const auto& arg : args)
+    {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        execvp(argv[0], argv.data());
+        fprintf(stderr, "Error: cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        fprintf(stderr, "Error: fork: %s\n", strerror(errno));
+        return false;
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (EINTR != errno)
+        {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && 0 == WEXITSTATUS(status);
+}
+
+/*!
+ * @brief This function links an object file with the system C compiler.
+ */
+bool
+link_object (const llvm::SmallVectorImpl<char>& object,
+             const std::string& out,
+             bool shared)
+{
+    return link_objects({ llvm::StringRef(object.data(), object.size()) }, out, shared);
+}
+
+/*!
+ * @brief This function links several object files together with the
+ *          system C compiler.
+ */
+bool
+link_objects (const std::vector<llvm::StringRef>& objects,
+              const std::string& out,
+              bool shared)
+{
+    // The objects go to temporary files for the linker.
+    std::vector<std::string> paths;
+    bool ok = true;
+    for (const auto& object : objects)
+    {
+        char obj_path[] = "/tmp/kaleidoscope_XXXXXX.o";
+        int fd = mkstemps(obj_path, 2);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Error: cannot create a temporary object file\n");
+            ok = false;
+            break;
+        }
+        paths.push_back(obj_path);
+
+        ok = write(fd, object.data(), object.size()) == (ssize_t) object.size();
+        close(fd);
+        if (!ok)
+        {
+            break;
+        }
+    }
+
+    // A shared object binds calls to its own functions, so a definition
+    // named like a libc function (e.g. "step") is not interposed.
+    std::vector<std::string> args = { "cc" };
+    if (shared)
+    {
+        args.push_back("-shared");
+        args.push_back("-Wl,-Bsymbolic-functions");
+    }
+    args.insert(args.end(), paths.begin(), paths.end());
+    args.push_back("-o");
+    args.push_back(out);
+    args.push_back("-lm");
+    ok = ok && run_command(args);
+
+    for (const auto& path : paths)
+    {
+        unlink(path.c_str());
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Error: linking %s failed\n", out.c_str());
+    }
+
+    return ok;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,130 @@
+/*!
+ * @file src/compiler.hpp
+ *
+ * @brief This file contains the optimization and object emission stages
+ *          that run after codegen.
+ */
+
+#ifndef _LLVM_COMPILER_H
+#define _LLVM_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+/*!
+ * @brief This enum contains the ways the driver can execute a program.
+ */
+enum Engine
+{
+    engine_jit,     // Compile each item with the JIT and run it.
+    engine_interp,  // Walk the AST; generate no code.
+    engine_aot,     // Compile the whole program to an executable.
+};
+
+// The target machine is per thread, as it is not safe to share.
+extern thread_local std::unique_ptr<llvm::TargetMachine> g_target_machine;
+extern int g_opt_level;
+extern Engine g_engine;
+
+// Whether definitions are compiled only once a top-level expression can
+// reach them, rather than as they are read.
+extern bool g_demand_codegen;
+
+// The top-level expressions of an AOT build, in program order.
+extern thread_local std::vector<std::string> g_aot_entries;
+
+/*!
+ * @brief This function initializes the native target and creates the
+ *          calling thread's target machine used for emission.
+ *
+ * @param opt_level The optimization level, 0 through 3.
+ *
+ * @return True on success.
+ */
+bool
+init_native_target (int opt_level);
+
+/*!
+ * @brief This function creates a fresh g_context, g_builder and g_module,
+ *          the module configured for the native target.
+ *
+ * @param name The module identifier.
+ */
+void
+init_module (const std::string& name);
+
+/*!
+ * @brief This function runs the standard LLVM pipeline for an
+ *          optimization level over a module.
+ *
+ * @param opt_level The optimization level, 0 through 3.
+ */
+void
+optimize_module (llvm::Module& module, int opt_level);
+
+/*!
+ * @brief This function prepares a whole program for optimization as a
+ *          closed world: everything but "main" and the exports becomes
+ *          internal, internal functions use the fast calling convention,
+ *          and global DCE and the interprocedural passes are run.
+ *
+ * @param exports The functions to keep visible outside the module.
+ */
+void
+internalize_module (llvm::Module& module, const std::vector<std::string>& exports);
+
+/*!
+ * @brief This function emits a module as a native object file.
+ *
+ * @param out Receives the object file bytes.
+ *
+ * @return True on success.
+ */
+bool
+emit_object (llvm::Module& module, llvm::SmallVectorImpl<char>& out);
+
+/*!
+ * @brief This function adds a "main" to g_module that calls each function
+ *          in g_aot_entries in order and prints its result. Entries not
+ *          defined in g_module are declared, to be linked from elsewhere.
+ */
+void
+add_aot_main (void);
+
+/*!
+ * @brief This function links an object file with the system C compiler.
+ *
+ * @param object The object file bytes.
+ * @param out The path of the executable or shared object to write.
+ * @param shared True to link a shared object rather than an executable.
+ *
+ * @return True on success.
+ */
+bool
+link_object (const llvm::SmallVectorImpl<char>& object,
+             const std::string& out,
+             bool shared);
+
+/*!
+ * @brief This function links several object files together with the
+ *          system C compiler.
+ *
+ * @param objects The bytes of each object file.
+ * @param out The path of the executable or shared object to write.
+ * @param shared True to link a shared object rather than an executable.
+ *
+ * @return True on success.
+ */
+bool
+link_objects (const std::vector<llvm::StringRef>& objects,
+              const std::string& out,
+              bool shared);
+
+#endif // _LLVM_COMPILER_H
+
+/***   end of file   ***/
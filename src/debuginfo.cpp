@@ -0,0 +1,194 @@
+/*!
+ * @file src/debuginfo.cpp
+ *
+ * @brief This file contains the generation of DWARF debug info.
+ */
+
+#include "debuginfo.hpp"
+
+#include <unordered_map>
+
+#include "ast.hpp"
+#include "compiler.hpp"
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/Support/Path.h"
+
+bool g_debug_info = false;
+
+std::string g_debug_source;
+
+// The debug info of the module being generated on this thread. The builder
+// holds references into its context, so it goes before the module does.
+static thread_local std::unique_ptr<llvm::DIBuilder> di_builder;
+static thread_local llvm::Module * p_di_module = nullptr;
+static thread_local llvm::DICompileUnit * p_di_unit = nullptr;
+static thread_local llvm::DIType * p_di_double = nullptr;
+static thread_local llvm::DISubprogram * p_di_function = nullptr;
+
+// The locations of the expression nodes parsed on this thread.
+static thread_local std::unordered_map<const ExprAST *, SourceLocation> node_locations;
+
+/*!
+ * @brief This function starts the calling thread's debug info for a fresh
+ *          module.
+ */
+void
+debug_init_module (llvm::Module& module, const std::string& name)
+{
+    debug_reset();
+
+    llvm::StringRef path = g_debug_source.empty() ? name : g_debug_source;
+    di_builder = std::make_unique<llvm::DIBuilder>(module);
+    p_di_module = &module;
+    p_di_unit = di_builder->createCompileUnit(
+        llvm::dwarf::DW_LANG_C,
+        di_builder->createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path)),
+        "Kaleidoscope Compiler",
+        g_opt_level > 0,
+        "",
+        0
+    );
+
+    p_di_double = di_builder->createBasicType("double", 64, llvm::dwarf::DW_ATE_float);
+
+    module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+/*!
+ * @brief This function drops the calling thread's unfinished debug info.
+ */
+void
+debug_reset (void)
+{
+    di_builder.reset();
+    p_di_module = nullptr;
+    p_di_unit = nullptr;
+    p_di_double = nullptr;
+    p_di_function = nullptr;
+}
+
+/*!
+ * @brief This function gives a function a subprogram at its location, with
+ *          every argument a double and so is the result.
+ */
+void
+debug_begin_function (llvm::Function& fn, SourceLocation loc)
+{
+    if (!di_builder)
+    {
+        return;
+    }
+
+    llvm::SmallVector<llvm::Metadata *, 8> types(fn.arg_size() + 1, p_di_double);
+
+    llvm::DIFile * p_file = p_di_unit->getFile();
+    p_di_function = di_builder->createFunction(
+        p_file,
+        fn.getName(),
+        llvm::StringRef(),
+        p_file,
+        loc.line,
+        di_builder->createSubroutineType(di_builder->getOrCreateTypeArray(types)),
+        loc.line,
+        loc.line ? llvm::DINode::FlagPrototyped : llvm::DINode::FlagArtificial,
+        llvm::DISubprogram::SPFlagDefinition
+    );
+    fn.setSubprogram(p_di_function);
+
+    // Profilers walk the stack through the frame pointer.
+    fn.addFnAttr("frame-pointer", "all");
+
+    // Describe the arguments, which live in registers rather than allocas.
+    llvm::IRBuilder<>& builder = *g_builder;
+    llvm::DILocation * p_loc = llvm::DILocation::get(*g_context, loc.line, loc.col, p_di_function);
+    builder.SetCurrentDebugLocation(p_loc);
+    unsigned arg_no = 0;
+    for (llvm::Argument& arg : fn.args())
+    {
+        llvm::DILocalVariable * p_var = di_builder->createParameterVariable(
+            p_di_function, arg.getName(), ++arg_no, p_file, loc.line, p_di_double, true
+        );
+        di_builder->insertDbgValueIntrinsic(&arg, p_var, di_builder->createExpression(),
+                                            p_loc, builder.GetInsertBlock());
+    }
+}
+
+/*!
+ * @brief This function sets the location of the instructions built next.
+ */
+void
+debug_set_location (SourceLocation loc)
+{
+    if (p_di_function && loc.line)
+    {
+        g_builder->SetCurrentDebugLocation(
+            llvm::DILocation::get(*g_context, loc.line, loc.col, p_di_function)
+        );
+    }
+}
+
+/*!
+ * @brief This function records where an expression node begins, unless it
+ *          already has a location.
+ */
+void
+debug_note_location (const ExprAST * p_node, SourceLocation loc)
+{
+    if (loc.line)
+    {
+        node_locations.emplace(p_node, loc);
+    }
+}
+
+/*!
+ * @brief This function returns the location recorded for an expression node.
+ */
+SourceLocation
+debug_node_location (const ExprAST * p_node)
+{
+    auto it = node_locations.find(p_node);
+    return it == node_locations.end() ? SourceLocation() : it->second;
+}
+
+/*!
+ * @brief This function drops the location of an expression node.
+ */
+void
+debug_forget_location (const ExprAST * p_node)
+{
+    node_locations.erase(p_node);
+}
+
+/*!
+ * @brief This function completes the current function's subprogram. Code
+ *          built after it has no location, as it belongs to no function's
+ *          scope.
+ */
+void
+debug_end_function (void)
+{
+    if (p_di_function)
+    {
+        di_builder->finalizeSubprogram(p_di_function);
+        p_di_function = nullptr;
+        g_builder->SetCurrentDebugLocation(llvm::DebugLoc());
+    }
+}
+
+/*!
+ * @brief This function completes the debug info of a module.
+ */
+void
+debug_finalize_module (llvm::Module& module)
+{
+    if (di_builder && p_di_module == &module)
+    {
+        di_builder->finalize();
+        debug_reset();
+    }
+}
+
+/***   end of file   ***/
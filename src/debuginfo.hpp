@@ -0,0 +1,97 @@
+/*!
+ * @file src/debuginfo.hpp
+ *
+ * @brief This file contains the generation of DWARF debug info: a
+ *          subprogram for each function and a line and column for each
+ *          instruction, so that profilers can attribute time to source lines.
+ */
+
+#ifndef _LLVM_DEBUGINFO_H
+#define _LLVM_DEBUGINFO_H
+
+#include <string>
+
+#include "lexer.hpp"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+class ExprAST;
+
+// Whether modules are generated with debug info.
+extern bool g_debug_info;
+
+// The source file named in the debug info, when it is not the module's name,
+// such as the file standard input was redirected from.
+extern std::string g_debug_source;
+
+/*!
+ * @brief This function starts the calling thread's debug info for a fresh
+ *          module: its compile unit, and the flags that mark it as DWARF.
+ *
+ * @param name The module's name, used as its file if g_debug_source is empty.
+ */
+void
+debug_init_module (llvm::Module& module, const std::string& name);
+
+/*!
+ * @brief This function drops the calling thread's unfinished debug info,
+ *          before its module is discarded.
+ */
+void
+debug_reset (void);
+
+/*!
+ * @brief This function gives a function a subprogram at its location, and
+ *          keeps its frame pointer. Instructions built after this are in
+ *          its scope until debug_end_function().
+ */
+void
+debug_begin_function (llvm::Function& fn, SourceLocation loc);
+
+/*!
+ * @brief This function sets the location of the instructions built next.
+ *          Unknown locations keep the last one.
+ */
+void
+debug_set_location (SourceLocation loc);
+
+/*!
+ * @brief This function records where an expression node begins, or where its
+ *          operator is, unless it already has a location. Locations are kept
+ *          apart from the nodes, so that nodes cost nothing more without
+ *          debug info.
+ */
+void
+debug_note_location (const ExprAST * p_node, SourceLocation loc);
+
+/*!
+ * @brief This function returns the location recorded for an expression node,
+ *          or an unknown one.
+ */
+SourceLocation
+debug_node_location (const ExprAST * p_node);
+
+/*!
+ * @brief This function drops the location of an expression node that is
+ *          being destroyed.
+ */
+void
+debug_forget_location (const ExprAST * p_node);
+
+/*!
+ * @brief This function completes the current function's subprogram.
+ */
+void
+debug_end_function (void);
+
+/*!
+ * @brief This function completes the debug info of a module, once all its
+ *          functions are generated. It does nothing for a module without.
+ */
+void
+debug_finalize_module (llvm::Module& module);
+
+#endif // _LLVM_DEBUGINFO_H
+
+/***   end of file   ***/
@@ -0,0 +1,97 @@
+/*!
+ * @file src/executor.cpp
+ *
+ * @brief This file contains the out-of-process executor.
+ *
+ *          The driver starts it with "--out-of-process" and connects to it
+ *              over a pair of pipes. JIT'd code is linked into this process and
+ *              runs here, so a crash in user code ends only the executor and
+ *              leaves the compiler and its caches intact.
+ *
+ *          Usage: kaleidoscope-executor IN_FD OUT_FD
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "executor.hpp"
+
+#include "llvm/ExecutionEngine/Orc/Shared/WrapperFunctionUtils.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/SimpleExecutorDylibManager.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/SimpleExecutorMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/SimpleRemoteEPCServer.h"
+
+/*!
+ * @brief This function calls a JIT'd function on behalf of the compiler.
+ */
+static llvm::orc::shared::CWrapperFunctionResult
+call_wrapper (const char * p_data, size_t size)
+{
+    using namespace llvm::orc;
+
+    return shared::WrapperFunction<ExecutorCallSig>::handle(
+        p_data, size,
+        [](ExecutorAddr fn, std::vector<uint64_t> bits) -> uint64_t
+        {
+            double args[EXECUTOR_MAX_ARGS] = {};
+            memcpy(args, bits.data(), bits.size() * sizeof(double));
+
+            double result = 0.0;
+            switch (bits.size())
+            {
+                case 0: result = fn.toPtr<double (*)()>()(); break;
+                case 1: result = fn.toPtr<double (*)(double)>()(args[0]); break;
+                case 2: result = fn.toPtr<double (*)(double, double)>()(args[0], args[1]); break;
+                case 3: result = fn.toPtr<double (*)(double, double, double)>()(args[0], args[1], args[2]); break;
+                case 4: result = fn.toPtr<double (*)(double, double, double, double)>()(args[0], args[1], args[2], args[3]); break;
+            }
+
+            uint64_t out;
+            memcpy(&out, &result, sizeof(out));
+            return out;
+        }
+    ).release();
+}
+
+int main (int argc, char ** argv)
+{
+    using namespace llvm::orc;
+
+    if (3 != argc)
+    {
+        fprintf(stderr, "Usage: %s IN_FD OUT_FD\n", argv[0]);
+        return 1;
+    }
+    int in_fd = atoi(argv[1]);
+    int out_fd = atoi(argv[2]);
+
+    auto server = SimpleRemoteEPCServer::Create<FDSimpleRemoteEPCTransport>(
+        [](SimpleRemoteEPCServer::Setup& setup)
+        {
+            setup.setDispatcher(std::make_unique<SimpleRemoteEPCServer::ThreadDispatcher>());
+            setup.bootstrapSymbols() = SimpleRemoteEPCServer::defaultBootstrapSymbols();
+            setup.bootstrapSymbols()[EXECUTOR_CALL_WRAPPER] = ExecutorAddr::fromPtr(&call_wrapper);
+            setup.services().push_back(std::make_unique<rt_bootstrap::SimpleExecutorMemoryManager>());
+            setup.services().push_back(std::make_unique<rt_bootstrap::SimpleExecutorDylibManager>());
+            return llvm::Error::success();
+        },
+        in_fd, out_fd
+    );
+    if (!server)
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(server.takeError()).c_str());
+        return 1;
+    }
+
+    // Serve requests until the compiler disconnects.
+    if (llvm::Error err = (*server)->waitForDisconnect())
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(std::move(err)).c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+/***   end of file   ***/
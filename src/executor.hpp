@@ -0,0 +1,35 @@
+/*!
+ * @file src/executor.hpp
+ *
+ * @brief This file contains the interface shared by the JIT and the
+ *          out-of-process executor that runs the code it generates.
+ */
+
+#ifndef _LLVM_EXECUTOR_H
+#define _LLVM_EXECUTOR_H
+
+#include "llvm/ExecutionEngine/Orc/Shared/ExecutorAddress.h"
+#include "llvm/ExecutionEngine/Orc/Shared/SimplePackedSerialization.h"
+
+/*!
+ * @brief The bootstrap symbol of the executor's call wrapper.
+ *
+ *          The wrapper calls a JIT'd function of up to four doubles.
+ *              Doubles have no serializer, so arguments and result cross
+ *              the connection as their bit patterns.
+ */
+#define EXECUTOR_CALL_WRAPPER "__kaleidoscope_call_wrapper"
+
+/*!
+ * @brief The maximum number of arguments the call wrapper passes.
+ */
+#define EXECUTOR_MAX_ARGS 4
+
+typedef uint64_t ExecutorCallSig (
+    llvm::orc::shared::SPSExecutorAddr,
+    llvm::orc::shared::SPSSequence<uint64_t>
+);
+
+#endif // _LLVM_EXECUTOR_H
+
+/***   end of file   ***/
@@ -0,0 +1,447 @@
+/*!
+ * @file src/interp.cpp
+ *
+ * @brief This file contains the tree-walking evaluator for the AST.
+ *
+ *          It executes definitions without generating any code, which
+ *              trades per-call speed for zero compile time.
+ */
+
+#include <dlfcn.h>
+
+#include <cmath>
+#include <cstdint>
+
+#include "ast.hpp"
+
+/*!
+ * @brief This map holds the definitions the evaluator can call.
+ */
+thread_local std::map<std::string, std::unique_ptr<FunctionAST>> g_interp_functions;
+
+// The host functions externs have resolved to, by name. Entries are never
+// removed, so calls can keep a pointer to theirs.
+static thread_local std::map<std::string, void *> host_functions;
+
+// The argument names and values of the function being evaluated.
+static thread_local const std::vector<std::string> * p_frame_names = nullptr;
+static thread_local const double * p_frame_values = nullptr;
+
+/******************************************************************************/
+
+// How deep evaluation recurses on the thread's stack, counting both operands
+// and calls. Below this depth it continues with an explicit stack instead.
+static const unsigned max_eval_recursion = 1u << 10;
+static thread_local unsigned eval_recursion = 0;
+
+/******************************************************************************/
+
+/*!
+ * @brief This function evaluates an expression tree with an explicit stack.
+ *
+ *          The tree is walked in post-order, as codegen walks it, so the
+ *              depth of the tree is not limited by the depth of the thread's
+ *              stack. A call to a definition evaluates its body on the same
+ *              stacks, above the caller's, so neither is a chain of calls.
+ */
+double
+ExprAST::evaluate_walk()
+{
+    // A node being evaluated, with the next operand to visit and where its
+    // operands' values start on the value stack.
+    struct Frame
+    {
+        ExprAST * p_node;
+        size_t next;
+        size_t base;
+    };
+
+    // A call to a definition whose body is being evaluated: the arguments,
+    // and the frame of the caller to return to.
+    struct Call
+    {
+        std::vector<double> args;
+        const std::vector<std::string> * p_names;
+        const double * p_values;
+    };
+
+    // The next operand of a call frame whose callee's body is running.
+    static const size_t calling = SIZE_MAX;
+
+    static thread_local std::vector<Frame> frames;
+    static thread_local std::vector<double> values;
+    static thread_local std::vector<Call> calls;
+    size_t bottom = frames.size();
+    size_t values_bottom = values.size();
+    size_t calls_bottom = calls.size();
+
+    auto descend = [bottom](ExprAST * p_node)
+    {
+        if (frames.size() - bottom >= max_codegen_depth)
+        {
+            log_error("Expression nested too deeply to evaluate");
+            return false;
+        }
+        if (!p_node->evaluate_enter())
+        {
+            return false;
+        }
+        frames.push_back({ p_node, 0, values.size() });
+        return true;
+    };
+
+    if (!evaluate_enter())
+    {
+        return NAN;
+    }
+    frames.push_back({ this, 0, values_bottom });
+
+    while (frames.size() > bottom)
+    {
+        Frame& top = frames.back();
+
+        // The callee's body is done; return to the caller's frame with its
+        // value in place of the call.
+        if (calling == top.next)
+        {
+            double v = values.back();
+            p_frame_names = calls.back().p_names;
+            p_frame_values = calls.back().p_values;
+            calls.pop_back();
+            values.resize(top.base);
+            values.push_back(v);
+            frames.pop_back();
+            continue;
+        }
+
+        // Descend into the next operand.
+        if (top.next < top.p_node->num_operands())
+        {
+            if (!descend(top.p_node->get_operand(top.next++)))
+            {
+                break;
+            }
+            continue;
+        }
+
+        // A definition's body runs above the call, in a frame of its
+        // arguments.
+        ExprAST * p_node = top.p_node;
+        size_t base = top.base;
+        if (FunctionAST * p_def = p_node->evaluate_callee())
+        {
+            top.next = calling;
+            calls.push_back({ std::vector<double>(values.begin() + base, values.end()),
+                              p_frame_names, p_frame_values });
+            p_frame_names = &p_def->get_proto().get_args();
+            p_frame_values = calls.back().args.data();
+            if (!descend(p_def->get_body()))
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Every operand is done; evaluate the node in their place.
+        double v = p_node->evaluate_emit(values.data() + base);
+        values.resize(base);
+        values.push_back(v);
+        frames.pop_back();
+    }
+
+    // Leave the stacks and the frame of arguments as the caller had them,
+    // also after an error.
+    double result = frames.size() > bottom ? NAN : values.back();
+    if (calls.size() > calls_bottom)
+    {
+        p_frame_names = calls[calls_bottom].p_names;
+        p_frame_values = calls[calls_bottom].p_values;
+    }
+    frames.resize(bottom);
+    values.resize(values_bottom);
+    calls.resize(calls_bottom);
+    return result;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function evaluates a NumberExprAST object.
+ */
+double
+NumberExprAST::evaluate()
+{
+    return val;
+}
+
+/*!
+ * @brief This function evaluates a NumberExprAST object for the explicit
+ *          stack walk.
+ */
+double
+NumberExprAST::evaluate_emit(const double *)
+{
+    return val;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function evaluates a VariableExprAST object.
+ */
+double
+VariableExprAST::evaluate()
+{
+    // Resolve the argument index once; a node only ever runs in one function.
+    if (slot < 0 && p_frame_names)
+    {
+        for (size_t i = 0; i < p_frame_names->size(); ++i)
+        {
+            if ((*p_frame_names)[i] == name)
+            {
+                slot = (int) i;
+                break;
+            }
+        }
+    }
+
+    if (slot < 0)
+    {
+        log_error("Unknown variable name");
+        return NAN;
+    }
+
+    return p_frame_values[slot];
+}
+
+/*!
+ * @brief This function evaluates a VariableExprAST object for the explicit
+ *          stack walk.
+ */
+double
+VariableExprAST::evaluate_emit(const double *)
+{
+    return VariableExprAST::evaluate();
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function evaluates a BinaryExprAST object.
+ */
+double
+BinaryExprAST::evaluate()
+{
+    if (eval_recursion >= max_eval_recursion)
+    {
+        return evaluate_walk();
+    }
+
+    ++eval_recursion;
+    double operands[2] = { lhs->evaluate(), rhs->evaluate() };
+    --eval_recursion;
+
+    return BinaryExprAST::evaluate_emit(operands);
+}
+
+/*!
+ * @brief This function evaluates a BinaryExprAST object, given the values of
+ *          its operands.
+ */
+double
+BinaryExprAST::evaluate_emit(const double * p_operands)
+{
+    double l = p_operands[0];
+    double r = p_operands[1];
+
+    switch (op)
+    {
+        case '+':
+            return l + r;
+        case '-':
+            return l - r;
+        case '*':
+            return l * r;
+
+        // Unordered less-than, as the generated code uses.
+        case '<':
+            return !(l >= r) ? 1.0 : 0.0;
+
+        default:
+            log_error("Invalid binary operator");
+            return NAN;
+    }
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function evaluates a CallExprAST object.
+ */
+double
+CallExprAST::evaluate()
+{
+    if (eval_recursion >= max_eval_recursion)
+    {
+        return evaluate_walk();
+    }
+
+    if (!callee_ref.getPointer() && !CallExprAST::evaluate_enter())
+    {
+        return NAN;
+    }
+
+    // Evaluate the arguments.
+    double small[8];
+    std::vector<double> large;
+    double * p_vals = small;
+    if (args.size() > 8)
+    {
+        large.resize(args.size());
+        p_vals = large.data();
+    }
+    // The callee's body recurses further, so it counts as a level too.
+    ++eval_recursion;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        p_vals[i] = args[i]->evaluate();
+    }
+    double result = evaluate_call(p_vals);
+    --eval_recursion;
+
+    return result;
+}
+
+/*!
+ * @brief This function resolves the callee of a CallExprAST object, before
+ *          its arguments are evaluated.
+ */
+bool
+CallExprAST::evaluate_enter()
+{
+    // Resolve the callee once: a definition first, then a host function
+    // declared by an extern, as the generated code would.
+    if (!callee_ref.getPointer())
+    {
+        size_t n_params = 0;
+        auto it = g_interp_functions.find(callee);
+        if (it != g_interp_functions.end())
+        {
+            callee_ref.setPointerAndInt(it->second.get(), false);
+            n_params = it->second->get_proto().get_args().size();
+        }
+        else
+        {
+            auto proto = g_function_protos.find(callee);
+            if (proto != g_function_protos.end())
+            {
+                auto host = host_functions.emplace(callee, nullptr).first;
+                if (!host->second)
+                {
+                    host->second = dlsym(RTLD_DEFAULT, callee.c_str());
+                }
+                if (host->second)
+                {
+                    callee_ref.setPointerAndInt(&host->second, true);
+                }
+                n_params = proto->second->get_args().size();
+            }
+        }
+
+        if (!callee_ref.getPointer())
+        {
+            log_error("Unknown function referenced");
+            return false;
+        }
+
+        if (n_params != args.size())
+        {
+            callee_ref.setPointerAndInt(nullptr, false);
+            log_error("Incorrect number of args passed");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function evaluates a CallExprAST object, given the values of
+ *          its arguments.
+ */
+double
+CallExprAST::evaluate_emit(const double * p_operands)
+{
+    // The callee's body is evaluated on the value stack the arguments are
+    // on, so they are copied out first.
+    double small[8];
+    std::vector<double> large;
+    double * p_vals = small;
+    if (args.size() > 8)
+    {
+        large.resize(args.size());
+        p_vals = large.data();
+    }
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        p_vals[i] = p_operands[i];
+    }
+
+    return evaluate_call(p_vals);
+}
+
+/*!
+ * @brief This function calls the callee of a CallExprAST object with the
+ *          values of its arguments.
+ */
+double
+CallExprAST::evaluate_call(const double * p_vals)
+{
+    if (!callee_ref.getInt())
+    {
+        return ((FunctionAST *) callee_ref.getPointer())->evaluate(p_vals);
+    }
+
+    // Host functions take and return doubles, as externs do.
+    void * p_callee_ext = *(void **) callee_ref.getPointer();
+    switch (args.size())
+    {
+        case 0:
+            return ((double (*)()) p_callee_ext)();
+        case 1:
+            return ((double (*)(double)) p_callee_ext)(p_vals[0]);
+        case 2:
+            return ((double (*)(double, double)) p_callee_ext)(p_vals[0], p_vals[1]);
+        case 3:
+            return ((double (*)(double, double, double)) p_callee_ext)(p_vals[0], p_vals[1], p_vals[2]);
+        case 4:
+            return ((double (*)(double, double, double, double)) p_callee_ext)(p_vals[0], p_vals[1], p_vals[2], p_vals[3]);
+        default:
+            log_error("Too many args for an extern");
+            return NAN;
+    }
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function evaluates a FunctionAST object.
+ */
+double
+FunctionAST::evaluate(const double * p_args)
+{
+    // Enter a new frame.
+    const std::vector<std::string> * p_saved_names = p_frame_names;
+    const double * p_saved_values = p_frame_values;
+    p_frame_names = &proto->get_args();
+    p_frame_values = p_args;
+
+    double result = body->evaluate();
+
+    // Return to the caller's frame.
+    p_frame_names = p_saved_names;
+    p_frame_values = p_saved_values;
+    return result;
+}
+
+/***   end of file   ***/
@@ -0,0 +1,587 @@
+/*!
+ * @file src/jit.cpp
+ *
+ * @brief This file contains the JIT that executes generated code.
+ */
+
+#include "jit.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include "ast.hpp"
+#include "compiler.hpp"
+#include "debuginfo.hpp"
+#include "executor.hpp"
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/EPCDynamicLibrarySearchGenerator.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/SimpleRemoteEPC.h"
+#include "llvm/ExecutionEngine/Orc/TaskDispatch.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+
+std::unique_ptr<llvm::orc::LLJIT> g_jit;
+
+// The executor process and its call wrapper, when running out of process.
+static pid_t executor_pid = 0;
+static llvm::orc::ExecutorAddr executor_call;
+
+// The static call graph of the definitions added so far, and those already
+// requested or speculated, when compiling in the background. The JIT can be
+// driven from several threads at once, so they are kept under a lock.
+static unsigned jit_compile_threads = 0;
+static std::mutex call_graph_mutex;
+static std::map<std::string, std::vector<std::string>> call_graph;
+static std::set<std::string> requested;
+
+// The errors the JIT has reported outside of any call, e.g. from the compile
+// threads.
+static std::atomic<uint64_t> session_errors(0);
+
+/*!
+ * @brief This function tells whether the executor process has exited, and
+ *          if so reaps it. A broken connection is seen a moment before the
+ *          exit, so it waits up to max_ms for one.
+ */
+static bool
+executor_exited (int max_ms, int& status)
+{
+    static std::mutex reap_mutex;
+    static bool exited = false;
+    static int exit_status = 0;
+
+    std::lock_guard<std::mutex> lock(reap_mutex);
+    for (int ms = 0; !exited && executor_pid > 0; ++ms)
+    {
+        if (waitpid(executor_pid, &exit_status, WNOHANG) == executor_pid)
+        {
+            exited = true;
+            executor_pid = 0;
+        }
+        else if (ms >= max_ms)
+        {
+            break;
+        }
+        else
+        {
+            usleep(1000);
+        }
+    }
+    status = exit_status;
+    return exited && executor_call;
+}
+
+/*!
+ * @brief This function ends the process if the executor has exited: nothing
+ *          more can run, so every later item would fail.
+ */
+static void
+exit_if_executor_lost (void)
+{
+    int status = 0;
+    if (!executor_call || !executor_exited(100, status))
+    {
+        return;
+    }
+
+    if (WIFSIGNALED(status))
+    {
+        fprintf(stderr, "Error: The executor process was killed by signal %d\n", WTERMSIG(status));
+    }
+    else
+    {
+        fprintf(stderr, "Error: The executor process exited with status %d\n", WEXITSTATUS(status));
+    }
+    exit(1);
+}
+
+/*!
+ * @brief This function starts the executor next to the running binary and
+ *          connects to it over a pair of pipes.
+ */
+static std::unique_ptr<llvm::orc::ExecutorProcessControl>
+spawn_executor (void)
+{
+    // Reap the executor of a previous JIT, which has disconnected by now.
+    if (executor_pid > 0)
+    {
+        waitpid(executor_pid, nullptr, 0);
+        executor_pid = 0;
+    }
+
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len < 0)
+    {
+        fprintf(stderr, "Error: cannot locate the running binary\n");
+        return nullptr;
+    }
+    path[len] = '\0';
+    std::string exe = std::string(path, strrchr(path, '/')) + "/kaleidoscope-executor";
+
+    // One pipe each way, so that closing our write end is seen by the
+    // executor as end of input even while our reader is blocked.
+    int to_executor[2], from_executor[2];
+    if (0 != pipe2(to_executor, O_CLOEXEC) || 0 != pipe2(from_executor, O_CLOEXEC))
+    {
+        fprintf(stderr, "Error: pipe: %s\n", strerror(errno));
+        return nullptr;
+    }
+
+    // A crashed executor must show up as an error, not end this process.
+    signal(SIGPIPE, SIG_IGN);
+
+    executor_pid = fork();
+    if (0 == executor_pid)
+    {
+        // Only the executor's ends survive the exec.
+        fcntl(to_executor[0], F_SETFD, 0);
+        fcntl(from_executor[1], F_SETFD, 0);
+        std::string in = std::to_string(to_executor[0]);
+        std::string out = std::to_string(from_executor[1]);
+        execl(exe.c_str(), exe.c_str(), in.c_str(), out.c_str(), (char *) nullptr);
+        fprintf(stderr, "Error: cannot run %s: %s\n", exe.c_str(), strerror(errno));
+        _exit(127);
+    }
+    close(to_executor[0]);
+    close(from_executor[1]);
+    if (executor_pid < 0)
+    {
+        fprintf(stderr, "Error: fork: %s\n", strerror(errno));
+        close(to_executor[1]);
+        close(from_executor[0]);
+        return nullptr;
+    }
+
+    auto epc = llvm::orc::SimpleRemoteEPC::Create<llvm::orc::FDSimpleRemoteEPCTransport>(
+        std::make_unique<llvm::orc::DynamicThreadPoolTaskDispatcher>(),
+        llvm::orc::SimpleRemoteEPC::Setup(), from_executor[0], to_executor[1]
+    );
+    if (!epc)
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(epc.takeError()).c_str());
+        return nullptr;
+    }
+
+    if (llvm::Error err = (*epc)->getBootstrapSymbols({{executor_call, EXECUTOR_CALL_WRAPPER}}))
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(std::move(err)).c_str());
+        return nullptr;
+    }
+
+    return std::move(*epc);
+}
+
+/*!
+ * @brief This function creates the JIT for the host, resolving externs
+ *          against the symbols of the process that runs the code.
+ */
+bool
+init_jit (int opt_level, bool out_of_process, unsigned compile_threads)
+{
+    auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!jtmb)
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(jtmb.takeError()).c_str());
+        return false;
+    }
+    jtmb->setCodeGenOptLevel(opt_level == 0 ? llvm::CodeGenOpt::None
+                             : opt_level == 1 ? llvm::CodeGenOpt::Less
+                             : opt_level == 3 ? llvm::CodeGenOpt::Aggressive
+                             : llvm::CodeGenOpt::Default);
+
+    llvm::orc::LLJITBuilder builder;
+    builder.setJITTargetMachineBuilder(std::move(*jtmb))
+        .setNumCompileThreads(compile_threads);
+
+    jit_compile_threads = compile_threads;
+    call_graph.clear();
+    requested.clear();
+
+    // Out of process, JITLink allocates and links the code in the
+    // executor's memory, and there is no in-process platform runtime.
+    executor_call = llvm::orc::ExecutorAddr();
+    if (out_of_process)
+    {
+        auto epc = spawn_executor();
+        if (!epc)
+        {
+            return false;
+        }
+        builder.setExecutorProcessControl(std::move(epc))
+            .setObjectLinkingLayerCreator(
+                [](llvm::orc::ExecutionSession& es, const llvm::Triple&)
+                    -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>>
+                {
+                    return std::make_unique<llvm::orc::ObjectLinkingLayer>(es);
+                })
+            .setPlatformSetUp([](llvm::orc::LLJIT&) { return llvm::Error::success(); });
+    }
+    else if (g_debug_info)
+    {
+        // Tell debuggers and perf about each object's code and line
+        // tables as it is loaded.
+        builder.setObjectLinkingLayerCreator(
+            [](llvm::orc::ExecutionSession& es, const llvm::Triple&)
+                -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>>
+            {
+                auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+                    es, [] { return std::make_unique<llvm::SectionMemoryManager>(); }
+                );
+                layer->registerJITEventListener(*llvm::JITEventListener::createGDBRegistrationListener());
+                if (llvm::JITEventListener * p_perf = llvm::JITEventListener::createPerfJITEventListener())
+                {
+                    layer->registerJITEventListener(*p_perf);
+                }
+                return layer;
+            });
+    }
+
+    auto jit = builder.create();
+    if (!jit)
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(jit.takeError()).c_str());
+        return false;
+    }
+    g_jit = std::move(*jit);
+    g_jit->getExecutionSession().setErrorReporter([](llvm::Error err)
+    {
+        ++session_errors;
+
+        // A lost executor is reported once, by the item that runs into it.
+        int status = 0;
+        if (executor_call && executor_exited(100, status))
+        {
+            llvm::consumeError(std::move(err));
+            return;
+        }
+        llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "JIT session error: ");
+    });
+
+    // Let generated code call into the process that runs it, e.g.
+    // "extern sin(x);".
+    if (out_of_process)
+    {
+        auto gen = llvm::orc::EPCDynamicLibrarySearchGenerator::GetForTargetProcess(
+            g_jit->getExecutionSession()
+        );
+        if (!gen)
+        {
+            fprintf(stderr, "Error: %s\n", llvm::toString(gen.takeError()).c_str());
+            return false;
+        }
+        g_jit->getMainJITDylib().addGenerator(std::move(*gen));
+    }
+    else
+    {
+        auto gen = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            g_jit->getDataLayout().getGlobalPrefix()
+        );
+        if (!gen)
+        {
+            fprintf(stderr, "Error: %s\n", llvm::toString(gen.takeError()).c_str());
+            return false;
+        }
+        g_jit->getMainJITDylib().addGenerator(std::move(*gen));
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function hands g_module (and g_context) over to the JIT and
+ *          starts a fresh module for subsequent codegen.
+ */
+bool
+jit_add_module (llvm::orc::ResourceTrackerSP rt)
+{
+    std::string name = g_module->getModuleIdentifier();
+    g_builder.reset();
+
+    // Out of process, a caller can be reported ready while the finalize of
+    // a callee it links against is still in flight in the executor, so
+    // definitions are linked as soon as they are added.
+    std::vector<std::string> defined;
+    if (executor_call && !rt)
+    {
+        for (const llvm::Function& fn : *g_module)
+        {
+            if (!fn.isDeclaration())
+            {
+                defined.push_back(fn.getName().str());
+            }
+        }
+    }
+
+    llvm::orc::ThreadSafeModule tsm(std::move(g_module), std::move(g_context));
+    llvm::Error err = rt
+        ? g_jit->addIRModule(rt, std::move(tsm))
+        : g_jit->addIRModule(std::move(tsm));
+
+    init_module(name);
+
+    if (err)
+    {
+        exit_if_executor_lost();
+        fprintf(stderr, "Error: %s\n", llvm::toString(std::move(err)).c_str());
+        return false;
+    }
+
+    for (const auto& fn : defined)
+    {
+        if (!jit_lookup(fn))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function removes the code added under the given tracker, once
+ *          no compile thread can still be filing it.
+ */
+bool
+jit_remove (llvm::orc::ResourceTrackerSP rt)
+{
+    // LLVM 14's RTDyld reports a symbol ready just before it files the
+    // object's memory under the tracker, so a compile thread can still be
+    // on it when the lookup returns. Once every compile thread has picked up
+    // a task queued after that, each has finished what it was doing before.
+    // Two barriers at once could each hold some of the threads for good.
+    if (jit_compile_threads)
+    {
+        static std::mutex barrier_mutex;
+        std::lock_guard<std::mutex> barrier_lock(barrier_mutex);
+
+        struct Barrier
+        {
+            std::mutex mutex;
+            std::condition_variable all_parked;
+            unsigned parked = 0;
+        };
+        auto p_barrier = std::make_shared<Barrier>();
+        unsigned n = jit_compile_threads;
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            g_jit->getExecutionSession().dispatchTask(llvm::orc::makeGenericNamedTask(
+                [p_barrier, n]
+                {
+                    std::unique_lock<std::mutex> lock(p_barrier->mutex);
+                    if (++p_barrier->parked == n)
+                    {
+                        p_barrier->all_parked.notify_all();
+                    }
+                    p_barrier->all_parked.wait(lock, [&] { return p_barrier->parked == n; });
+                },
+                "Compile thread barrier"
+            ));
+        }
+
+        std::unique_lock<std::mutex> lock(p_barrier->mutex);
+        p_barrier->all_parked.wait(lock, [&] { return p_barrier->parked == n; });
+    }
+
+    if (llvm::Error err = rt->remove())
+    {
+        fprintf(stderr, "Error: %s\n", llvm::toString(std::move(err)).c_str());
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * @brief This function looks up the address of a JIT'd symbol, compiling it
+ *          if necessary.
+ */
+void *
+jit_lookup (const std::string& name)
+{
+    // Compile what it calls alongside it.
+    if (jit_compile_threads)
+    {
+        std::vector<std::string> callees;
+        {
+            std::lock_guard<std::mutex> lock(call_graph_mutex);
+            requested.insert(name);
+            auto it = call_graph.find(name);
+            if (it != call_graph.end())
+            {
+                callees = it->second;
+            }
+        }
+        jit_speculate(callees);
+    }
+
+    auto sym = g_jit->lookup(name);
+    if (!sym)
+    {
+        exit_if_executor_lost();
+        fprintf(stderr, "Error: %s\n", llvm::toString(sym.takeError()).c_str());
+        return nullptr;
+    }
+
+    return (void *) sym->getAddress();
+}
+
+/*!
+ * @brief This function returns whether the generated code runs in this
+ *          process.
+ */
+bool
+jit_in_process (void)
+{
+    return !executor_call;
+}
+
+/*!
+ * @brief This function returns the number of errors the JITs have reported
+ *          on their own, e.g. from the compile threads.
+ */
+uint64_t
+jit_session_errors (void)
+{
+    return session_errors.load();
+}
+
+/*!
+ * @brief This function calls a JIT'd function of up to four doubles, in
+ *          whichever process runs the generated code.
+ */
+bool
+jit_call (void * p_fn, const double * p_args, size_t n_args, double& result)
+{
+    if (n_args > EXECUTOR_MAX_ARGS)
+    {
+        fprintf(stderr, "Error: Cannot call a function of %zu arguments\n", n_args);
+        return false;
+    }
+
+    // In process, call it directly.
+    if (!executor_call)
+    {
+        const double * a = p_args;
+        switch (n_args)
+        {
+            case 0: result = ((double (*)()) p_fn)(); break;
+            case 1: result = ((double (*)(double)) p_fn)(a[0]); break;
+            case 2: result = ((double (*)(double, double)) p_fn)(a[0], a[1]); break;
+            case 3: result = ((double (*)(double, double, double)) p_fn)(a[0], a[1], a[2]); break;
+            case 4: result = ((double (*)(double, double, double, double)) p_fn)(a[0], a[1], a[2], a[3]); break;
+        }
+        return true;
+    }
+
+    // Otherwise one round trip to the executor's call wrapper.
+    std::vector<uint64_t> bits(n_args);
+    memcpy(bits.data(), p_args, n_args * sizeof(double));
+
+    uint64_t out = 0;
+    llvm::Error err = g_jit->getExecutionSession().getExecutorProcessControl()
+        .callSPSWrapper<ExecutorCallSig>(
+            executor_call, out, llvm::orc::ExecutorAddr::fromPtr(p_fn), bits
+        );
+    if (err)
+    {
+        exit_if_executor_lost();
+        fprintf(stderr, "Error: %s\n", llvm::toString(std::move(err)).c_str());
+        return false;
+    }
+
+    memcpy(&result, &out, sizeof(result));
+    return true;
+}
+
+/*!
+ * @brief This function records the functions a JIT'd definition calls,
+ *          for speculation.
+ */
+void
+jit_record_callees (const std::string& name, std::vector<std::string> callees)
+{
+    std::lock_guard<std::mutex> lock(call_graph_mutex);
+    call_graph[name] = std::move(callees);
+}
+
+/*!
+ * @brief This function starts compiling, on the compile threads, every
+ *          recorded definition reachable from the given callees that has
+ *          not been requested yet.
+ */
+void
+jit_speculate (const std::vector<std::string>& callees)
+{
+    if (!jit_compile_threads)
+    {
+        return;
+    }
+
+    // Walk the call graph from the callees. Unknown names (externs, and
+    // functions not defined yet) are left to the real lookup.
+    llvm::orc::SymbolLookupSet symbols;
+    std::vector<const std::string *> pending;
+    for (const auto& callee : callees)
+    {
+        pending.push_back(&callee);
+    }
+    std::unique_lock<std::mutex> lock(call_graph_mutex);
+    while (!pending.empty())
+    {
+        const std::string& name = *pending.back();
+        pending.pop_back();
+
+        auto it = call_graph.find(name);
+        if (it == call_graph.end() || !requested.insert(name).second)
+        {
+            continue;
+        }
+        symbols.add(g_jit->mangleAndIntern(name));
+        for (const auto& callee : it->second)
+        {
+            pending.push_back(&callee);
+        }
+    }
+
+    lock.unlock();
+
+    if (symbols.empty())
+    {
+        return;
+    }
+
+    // An asynchronous lookup materializes them on the compile threads.
+    // Failures are reported again by the lookup that needs the symbol.
+    g_jit->getExecutionSession().lookup(
+        llvm::orc::LookupKind::Static,
+        llvm::orc::makeJITDylibSearchOrder(&g_jit->getMainJITDylib()),
+        std::move(symbols),
+        llvm::orc::SymbolState::Ready,
+        [](llvm::Expected<llvm::orc::SymbolMap> result)
+        {
+            if (!result)
+            {
+                llvm::consumeError(result.takeError());
+            }
+        },
+        llvm::orc::NoDependenciesToRegister
+    );
+}
+
+/***   end of file   ***/
@@ -0,0 +1,119 @@
+/*!
+ * @file src/jit.hpp
+ *
+ * @brief This file contains the JIT that executes generated code.
+ */
+
+#ifndef _LLVM_JIT_H
+#define _LLVM_JIT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+
+extern std::unique_ptr<llvm::orc::LLJIT> g_jit;
+
+/*!
+ * @brief This function creates the JIT for the host, resolving externs
+ *          against the symbols of the process that runs the code.
+ *
+ * @param opt_level The backend optimization level, 0 through 3.
+ * @param out_of_process Whether to run generated code in a separate
+ *          executor process ("kaleidoscope-executor", next to the running
+ *          binary) rather than in this one.
+ * @param compile_threads The number of threads that compile in the
+ *          background, which enables speculation. With none, everything
+ *          compiles on the thread that looks it up.
+ *
+ * @return True on success.
+ */
+bool
+init_jit (int opt_level, bool out_of_process = false, unsigned compile_threads = 0);
+
+/*!
+ * @brief This function hands g_module (and g_context) over to the JIT and
+ *          starts a fresh module for subsequent codegen.
+ *
+ * @param rt The resource tracker to add the module under, so that it can
+ *              be removed later. The main dylib's default tracker is used
+ *              when null.
+ *
+ * @return True on success.
+ */
+bool
+jit_add_module (llvm::orc::ResourceTrackerSP rt = nullptr);
+
+/*!
+ * @brief This function removes the code added under the given tracker.
+ *
+ *          With compile threads, it first waits until each of them has
+ *              finished what it was doing, since the code can be reported
+ *              ready before it is fully filed under its tracker.
+ *
+ * @return True on success.
+ */
+bool
+jit_remove (llvm::orc::ResourceTrackerSP rt);
+
+/*!
+ * @brief This function looks up the address of a JIT'd symbol, compiling it
+ *          if necessary.
+ *
+ *          Out of process, the address is the executor's and can only be
+ *              called through jit_call().
+ *
+ * @return The address, or nullptr if the symbol cannot be found.
+ */
+void *
+jit_lookup (const std::string& name);
+
+/*!
+ * @brief This function calls a JIT'd function of up to four doubles, in
+ *          whichever process runs the generated code.
+ *
+ * @param p_fn The address returned by jit_lookup().
+ * @param p_args The arguments.
+ * @param n_args The number of arguments.
+ * @param result Receives the return value.
+ *
+ * @return True on success.
+ */
+bool
+jit_call (void * p_fn, const double * p_args, size_t n_args, double& result);
+
+/*!
+ * @brief This function returns whether the generated code runs in this
+ *          process, so that jit_lookup()'s addresses can be called directly.
+ */
+bool
+jit_in_process (void);
+
+/*!
+ * @brief This function returns the number of errors the JITs have reported
+ *          on their own, outside of any lookup or call, e.g. from the
+ *          compile threads. They are printed as they happen.
+ */
+uint64_t
+jit_session_errors (void);
+
+/*!
+ * @brief This function records the functions a JIT'd definition calls,
+ *          for speculation.
+ */
+void
+jit_record_callees (const std::string& name, std::vector<std::string> callees);
+
+/*!
+ * @brief This function starts compiling, on the compile threads, every
+ *          recorded definition reachable from the given callees that has
+ *          not been requested yet, so that it is ready by the time it is
+ *          looked up. It does nothing without compile threads.
+ */
+void
+jit_speculate (const std::vector<std::string>& callees);
+
+#endif // _LLVM_JIT_H
+
+/***   end of file   ***/
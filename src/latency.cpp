@@ -0,0 +1,184 @@
+/*!
+ * @file src/latency.cpp
+ *
+ * @brief This file contains the high dynamic range latency histograms kept
+ *          for each kind of top-level item.
+ */
+
+#include <cmath>
+
+#include "latency.hpp"
+
+static const char * latency_name = "kaleidoscope_item_latency_seconds";
+static const char * latency_help =
+    "Latency of each top-level item, by kind and part, with 1% precision.";
+
+LatencyHistogram latency_def_compile(latency_name, latency_help,
+                                     "kind=\"def\",part=\"compile\"", "def compile");
+LatencyHistogram latency_extern_register(latency_name, latency_help,
+                                         "kind=\"extern\",part=\"register\"", "extern register");
+LatencyHistogram latency_expr_compile(latency_name, latency_help,
+                                      "kind=\"expression\",part=\"compile\"", "expr compile");
+LatencyHistogram latency_expr_execute(latency_name, latency_help,
+                                      "kind=\"expression\",part=\"execute\"", "expr execute");
+
+/*!
+ * @brief This function registers the histogram with the metrics. Its counts
+ *          are shared by every thread rather than kept in the shards.
+ */
+LatencyHistogram::LatencyHistogram(const char * p_name,
+                                   const char * p_help,
+                                   const char * p_labels,
+                                   const char * p_title)
+    : Metric(metric_summary, p_name, p_help, p_labels, 0), p_title(p_title),
+      counts(), total_count(0), total_ns(0)
+{
+}
+
+/*!
+ * @brief This function returns the index of the count a value falls in.
+ *
+ *          Values below sub_bucket_count are counted exactly. Above, the
+ *              position of the highest set bit picks the bucket and the
+ *              bits below it the sub-bucket, so it takes a count of leading
+ *              zeros and a shift.
+ */
+unsigned
+LatencyHistogram::index_of (uint64_t ns)
+{
+    unsigned pow2 = 64 - __builtin_clzll(ns | (sub_bucket_count - 1));
+    unsigned bucket = pow2 - sub_bucket_bits;
+    unsigned sub = (unsigned) (ns >> bucket);
+
+    return ((bucket + 1) << (sub_bucket_bits - 1)) + (sub - sub_bucket_half);
+}
+
+/*!
+ * @brief This function returns the largest value that falls in a count.
+ */
+uint64_t
+LatencyHistogram::highest_at (unsigned index)
+{
+    unsigned bucket = 0;
+    uint64_t sub = index;
+    if (index >= sub_bucket_count)
+    {
+        bucket = (index >> (sub_bucket_bits - 1)) - 1;
+        sub = (index & (sub_bucket_half - 1)) + sub_bucket_half;
+    }
+
+    return ((sub + 1) << bucket) - 1;
+}
+
+/*!
+ * @brief This function records one latency.
+ */
+void
+LatencyHistogram::record (double secs)
+{
+    uint64_t ns = 0;
+    if (secs > 0.0)
+    {
+        ns = secs * 1e9 < (double) max_ns ? (uint64_t) std::llround(secs * 1e9) : max_ns;
+    }
+
+    counts[index_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+/*!
+ * @brief This function returns the latency, in nanoseconds, that the given
+ *          percentage of those recorded are at or below, or 0 if none are.
+ *
+ *          The counts are read one at a time while other threads record,
+ *              so the answer may miss the latest few.
+ */
+uint64_t
+LatencyHistogram::value_at_percentile (double percentile) const
+{
+    uint64_t total = 0;
+    for (unsigned i = 0; i < n_counts; ++i)
+    {
+        total += counts[i].load(std::memory_order_relaxed);
+    }
+    if (!total)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t) std::ceil(percentile / 100.0 * total);
+    target = target < 1 ? 1 : target;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < n_counts; ++i)
+    {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            return highest_at(i);
+        }
+    }
+    return max_ns;
+}
+
+/*!
+ * @brief This function prints one row of the latency report, in
+ *          microseconds. Kinds with nothing recorded are left out.
+ */
+void
+LatencyHistogram::print_row (FILE * p_file) const
+{
+    uint64_t n = count();
+    if (!n)
+    {
+        return;
+    }
+
+    fprintf(p_file, "%-16s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            p_title, (unsigned long long) n,
+            value_at_percentile(0.0) / 1e3,
+            value_at_percentile(50.0) / 1e3,
+            value_at_percentile(90.0) / 1e3,
+            value_at_percentile(99.0) / 1e3,
+            value_at_percentile(99.9) / 1e3,
+            value_at_percentile(100.0) / 1e3,
+            total_ns.load(std::memory_order_relaxed) / 1e3 / n);
+}
+
+/*!
+ * @brief This function writes the histogram as a summary: its quantiles,
+ *          sum and count.
+ */
+void
+LatencyHistogram::write (FILE * p_file) const
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    for (double q : quantiles)
+    {
+        fprintf(p_file, "%s{%s,quantile=\"%g\"} %.9f\n",
+                p_name, p_labels, q, value_at_percentile(q * 100.0) / 1e9);
+    }
+    fprintf(p_file, "%s_sum{%s} %.9f\n",
+            p_name, p_labels, total_ns.load(std::memory_order_relaxed) / 1e9);
+    fprintf(p_file, "%s_count{%s} %llu\n",
+            p_name, p_labels, (unsigned long long) count());
+}
+
+/*!
+ * @brief This function prints a table of the percentiles of each item
+ *          kind's latency, in microseconds.
+ */
+void
+latency_print (FILE * p_file)
+{
+    fprintf(p_file, "%-16s %8s %10s %10s %10s %10s %10s %10s %10s\n",
+            "latency (us)", "count", "min", "p50", "p90", "p99", "p99.9", "max", "mean");
+    latency_def_compile.print_row(p_file);
+    latency_extern_register.print_row(p_file);
+    latency_expr_compile.print_row(p_file);
+    latency_expr_execute.print_row(p_file);
+}
+
+/***   end of file   ***/
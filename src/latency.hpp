@@ -0,0 +1,114 @@
+/*!
+ * @file src/latency.hpp
+ *
+ * @brief This file contains the high dynamic range latency histograms kept
+ *          for each kind of top-level item.
+ */
+
+#ifndef _LLVM_LATENCY_H
+#define _LLVM_LATENCY_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "metrics.hpp"
+
+/*!
+ * @brief This class is a latency histogram in the HdrHistogram layout: the
+ *          range is cut into power-of-two buckets, each split into the same
+ *          number of linear sub-buckets, so every value from 1ns to a
+ *          minute is kept to within 1%.
+ *
+ *          Recording finds the slot with a count of leading zeros and a
+ *              shift, and adds to it with one relaxed atomic add, so it
+ *              takes constant time and any thread can record without a
+ *              lock. Values above a minute are counted as a minute.
+ *
+ *          It is written to the metrics as a Prometheus summary.
+ */
+class LatencyHistogram : public Metric
+{
+public:
+    // Each power of two above the first is split into 128 sub-buckets, so
+    // a value is kept to within 1/128 of itself.
+    static const unsigned sub_bucket_bits = 8;
+    static const uint64_t sub_bucket_count = 1ull << sub_bucket_bits;
+    static const uint64_t sub_bucket_half = sub_bucket_count / 2;
+
+    // The largest value kept, in nanoseconds, and the counts that needs.
+    static const uint64_t max_ns = 60ull * 1000000000ull;
+    static const unsigned n_buckets = 29;   // max_ns < sub_bucket_count << 28.
+    static const unsigned n_counts = (n_buckets + 1) * sub_bucket_half;
+
+private:
+    const char * p_title;
+    std::atomic<uint64_t> counts[n_counts];
+    std::atomic<uint64_t> total_count;
+    std::atomic<uint64_t> total_ns;
+
+    static unsigned
+    index_of (uint64_t ns);
+
+    static uint64_t
+    highest_at (unsigned index);
+
+public:
+    /*!
+     * @brief This function registers the histogram with the metrics.
+     *
+     * @param p_title The name printed in the report, such as "def compile".
+     */
+    LatencyHistogram(const char * p_name,
+                     const char * p_help,
+                     const char * p_labels,
+                     const char * p_title);
+
+    /*!
+     * @brief This function records one latency.
+     */
+    void
+    record (double secs);
+
+    /*!
+     * @brief This function returns the number of latencies recorded.
+     */
+    uint64_t
+    count (void) const
+    {
+        return total_count.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief This function returns the latency, in nanoseconds, that the
+     *          given percentage of those recorded are at or below.
+     */
+    uint64_t
+    value_at_percentile (double percentile) const;
+
+    /*!
+     * @brief This function prints one row of the latency report.
+     */
+    void
+    print_row (FILE * p_file) const;
+
+    void
+    write (FILE * p_file) const override;
+};
+
+// The latency of each kind of item, and of each part of an expression.
+extern LatencyHistogram latency_def_compile;
+extern LatencyHistogram latency_extern_register;
+extern LatencyHistogram latency_expr_compile;
+extern LatencyHistogram latency_expr_execute;
+
+/*!
+ * @brief This function prints a table of the percentiles of each item
+ *          kind's latency, in microseconds.
+ */
+void
+latency_print (FILE * p_file);
+
+#endif // _LLVM_LATENCY_H
+
+/***   end of file   ***/
@@ -5,30 +5,150 @@
  */
 
 #include "lexer.hpp"
+#include "metrics.hpp"
 
-std::string identifier_str;
-double num_val;
+thread_local std::string identifier_str;
+thread_local double num_val;
+
+// The last character read but not yet consumed.
+static thread_local int last_char = ' ';
+
+// The in-memory input, if any. When null, standard input is used.
+static thread_local const char * p_input = nullptr;
+static thread_local const char * p_input_end = nullptr;
+
+// Where the last token began. In memory, only its address is kept, and the
+// line and column are counted up to it when asked for, from where the last
+// count stopped. Standard input is counted as it is read.
+static thread_local const char * p_tok_begin = nullptr;
+static thread_local const char * p_counted = nullptr;
+static thread_local SourceLocation counted_loc;
+static thread_local SourceLocation stdin_loc = { 1, 0 };
+static thread_local SourceLocation tok_loc;
 
 /*!
- * @brief This function is called to return the next token from standard
- *          input.
+ * @brief This function returns the next character of the input.
  */
-int
-gettok (void)
+static inline int
+next_char (void)
+{
+    if (!p_input)
+    {
+        // The character after a newline begins the next line.
+        if ('\n' == last_char)
+        {
+            ++stdin_loc.line;
+            stdin_loc.col = 0;
+        }
+        ++stdin_loc.col;
+        return getchar();
+    }
+
+    if (p_input == p_input_end)
+    {
+        return EOF;
+    }
+
+    return (unsigned char) *p_input++;
+}
+
+/*!
+ * @brief This function returns where the last token returned by gettok()
+ *          began.
+ */
+SourceLocation
+lexer_token_loc (void)
+{
+    if (!p_tok_begin)
+    {
+        return tok_loc;
+    }
+
+    for (; p_counted < p_tok_begin; ++p_counted)
+    {
+        if ('\n' == *p_counted)
+        {
+            ++counted_loc.line;
+            counted_loc.col = 1;
+        }
+        else
+        {
+            ++counted_loc.col;
+        }
+    }
+    return counted_loc;
+}
+
+/*!
+ * @brief This function points the lexer at an in-memory buffer instead of
+ *          standard input and resets its state.
+ */
+void
+lexer_set_input (const char * p_buf, size_t len)
+{
+    p_input = p_buf;
+    p_input_end = p_buf + len;
+    last_char = ' ';
+    p_tok_begin = p_buf;
+    p_counted = p_buf;
+    counted_loc = { 1, 1 };
+}
+
+/*!
+ * @brief This function points the lexer back at standard input and resets
+ *          its state.
+ */
+void
+lexer_reset (void)
 {
-    static int last_char = ' ';
+    p_input = nullptr;
+    p_input_end = nullptr;
+    last_char = ' ';
+    p_tok_begin = nullptr;
+    stdin_loc = { 1, 0 };
+    tok_loc = SourceLocation();
+}
+
+/*!
+ * @brief This function lexes the next token.
+ */
+static int
+lex_token (void)
+{
+    // Skip any whitespace and comments. This loops rather than recursing
+    // per comment so that long runs of comment lines use constant stack.
+    for (;;)
+    {
+        while (isspace(last_char))
+        {
+            last_char = next_char();
+        }
+
+        if ('#' != last_char)
+        {
+            break;
+        }
 
-    // Skip any whitespace.
-    while (isspace(last_char))
+        // Comment until EOL.
+        do
+        {
+            last_char = next_char();
+        } while (last_char != EOF && last_char != '\n' && last_char != '\r');
+    }
+    if (p_input)
+    {
+        p_tok_begin = EOF == last_char ? p_input : p_input - 1;
+    }
+    else
     {
-        last_char = getchar();
+        tok_loc = stdin_loc;
     }
 
     // Handle identifiers.
     if (isalpha(last_char))
     {
         identifier_str = last_char;
-        while (isalnum((last_char = getchar())))
+        while (isalnum((last_char = next_char())))
         {
             identifier_str += last_char;
         }
@@ -54,7 +174,7 @@ gettok (void)
         do
         {
             num_str += last_char;
-            last_char = getchar();
+            last_char = next_char();
         } while (isdigit(last_char) || last_char == '.');
 
         // TODO: More robust error handling instead of strtod.
@@ -62,21 +182,6 @@ gettok (void)
         return tok_number;
     }
 
-    // Handle comments.
-    if ('#' == last_char)
-    {
-        // Comment until EOL.
-        do
-        {
-            last_char = getchar();
-        } while (last_char != EOF && last_char != '\n' && last_char != '\r');
-
-        if (last_char != EOF)
-        {
-            return gettok();
-        }
-    }
-
     // Handle (but do not eat) EOF.
     if (last_char == EOF)
     {
@@ -85,8 +190,23 @@ gettok (void)
 
     // Return the character as its ASCII value.
     int this_char = last_char;
-    last_char = getchar();
+    last_char = next_char();
     return this_char;
 }
 
+/*!
+ * @brief This function is called to return the next token from standard
+ *          input.
+ */
+int
+gettok (void)
+{
+    int tok = lex_token();
+    if (tok_eof != tok)
+    {
+        metric_tokens_lexed.add();
+    }
+    return tok;
+}
+
 /***   end of file   ***/
@@ -7,11 +7,22 @@
 #ifndef _LLVM_LEXER_H
 #define _LLVM_LEXER_H
 
+#include <cstddef>
 #include <string>
 
-// Globals.
-extern std::string identifier_str;  // Filled in if tok_identifier.
-extern double num_val;              // Filled in if tok_number.
+/*!
+ * @brief This struct is a position in the source, counted from line 1 and
+ *          column 1 of the input.
+ */
+struct SourceLocation
+{
+    unsigned line = 0;      // 0 if unknown.
+    unsigned col = 0;
+};
+
+// Globals. Lexer state is per thread.
+extern thread_local std::string identifier_str;  // Filled in if tok_identifier.
+extern thread_local double num_val;              // Filled in if tok_number.
 
 /*!
  * @brief This enum contains the types of tokens.
@@ -36,6 +47,30 @@ enum Token
 int
 gettok (void);
 
+/*!
+ * @brief This function returns where the last token returned by gettok()
+ *          began.
+ */
+SourceLocation
+lexer_token_loc (void);
+
+/*!
+ * @brief This function points the lexer at an in-memory buffer instead of
+ *          standard input and resets its state.
+ *
+ * @param p_buf The buffer to read from. It must outlive the lexing.
+ * @param len The length of the buffer in bytes.
+ */
+void
+lexer_set_input (const char * p_buf, size_t len);
+
+/*!
+ * @brief This function points the lexer back at standard input and resets
+ *          its state.
+ */
+void
+lexer_reset (void);
+
 #endif // _LLVM_LEXER_H
 
 /***   end of file   ***/
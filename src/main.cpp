@@ -2,14 +2,405 @@
  * @file src/main.cpp
  *
  * @brief This file contains the driver code of the program.
+ *
+ *          Usage: kaleidoscope [-O0|-O1|-O2|-O3] [--engine jit|interp|aot]
+ *                              [--out-of-process] [--speculate N]
+ *                              [--demand-codegen] [--whole-program]
+ *                              [--export NAME]... [-o FILE]
+ *                              [--fast-math] [--fp-contract] [--fp-reassoc]
+ *                              [--no-simplify]
+ *                              [--metrics FILE [--metrics-interval SECS]]
+ *                              [--latency] [--bench N [--bench-cpu C]]
+ *                              [--remarks FILE] [--debug-info]
+ *                              [--max-depth N]
+ *                 kaleidoscope [-O0|-O1|-O2|-O3] [--jobs N] FILE...
+ *                 kaleidoscope [-O0|-O1|-O2|-O3] --procs N [-o FILE] FILE...
+ *
+ *          The program is read from standard input. The jit and interp
+ *              engines print the value of each top-level expression as it
+ *              is read; the aot engine writes an executable (a.out unless
+ *              -o is given) that prints them when run. With
+ *              --out-of-process the jit engine runs the generated code in
+ *              a separate executor process. With --speculate the jit
+ *              engine compiles on N background threads, and starts on a
+ *              function's callees as soon as the function is needed.
+ *              With --demand-codegen the jit and aot engines compile only
+ *              the definitions a top-level expression can reach, and report
+ *              how many were never needed.
+ *              With --whole-program the aot engine treats the program as
+ *              closed: only main and the --export'ed functions stay
+ *              visible, so the rest can be dropped or specialized. Either
+ *              option draws a warning with an engine that ignores it.
+ *
+ *          The -O, floating point and --no-simplify options apply to every
+ *              form, as do the --metrics options. --fast-math allows every
+ *              floating point relaxation, in the frontend passes and in
+ *              LLVM; --fp-contract allows just fusing a multiply and an
+ *              add, and --fp-reassoc just reordering arithmetic, such as
+ *              polynomials into Horner form. --no-simplify skips the
+ *              frontend rewrites of function bodies.
+ *
+ *          --max-depth limits how deeply an expression may nest, in every
+ *              form: the parser recurses into at most N parentheses and
+ *              call arguments, and codegen walks at most N levels of a
+ *              tree. The parser's recursion uses the thread's stack, so a
+ *              large N can overflow it.
+ *
+ *          With --metrics the counters, histograms and memory use are
+ *              written to FILE in the Prometheus text format every SECS
+ *              seconds (15 by default, 0 for never), whenever the process
+ *              gets SIGUSR1, and at exit. They include the latency of each
+ *              kind of item, kept in histograms precise to 1% from a
+ *              nanosecond to a minute; --latency also prints their
+ *              percentiles at exit.
+ *
+ *          With --bench the jit and interp engines also run each top-level
+ *              expression N more times, after a warmup, and print its ns
+ *              per run: the median, minimum and standard deviation over
+ *              samples of about 10us. --bench-cpu pins the runs to CPU C.
+ *
+ *          With --remarks the jit and aot engines collect LLVM's inlining,
+ *              vectorization, LICM and GVN remarks, and write them to FILE
+ *              at exit, grouped by definition: as YAML if FILE ends in
+ *              .yaml or .yml, as a report otherwise, or to stderr for "-".
+ *
+ *          With --debug-info every form generates DWARF line tables, with a
+ *              line and column for each instruction, and keeps frame
+ *              pointers. The source is the file standard input comes from,
+ *              or each FILE. The jit engine registers its code with GDB
+ *              and with perf's jitdump, so that perf annotate can show the
+ *              cost of each source line.
+ *
+ *          Given files, each is compiled independently to "<file>.o", on
+ *              up to N threads at once. With --procs they are instead
+ *              compiled in N worker processes and linked into one
+ *              executable, and each worker's utilization is reported.
  */
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
 #include "parser.hpp"
+#include "batch.hpp"
+#include "benchmark.hpp"
+#include "compiler.hpp"
+#include "debuginfo.hpp"
+#include "jit.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "remarks.hpp"
+#include "simplify.hpp"
+
+/*!
+ * @brief This function prints the usage message.
+ */
+static int
+usage (const char * p_prog)
+{
+    fprintf(stderr, "Usage: %s [-O0|-O1|-O2|-O3] [--engine jit|interp|aot] [--out-of-process] [--speculate N]\n", p_prog);
+    fprintf(stderr, "       %*s [--demand-codegen] [--whole-program] [--export NAME]... [-o FILE]\n",
+            (int) strlen(p_prog), "");
+    fprintf(stderr, "       %*s [--fast-math] [--fp-contract] [--fp-reassoc] [--no-simplify]\n",
+            (int) strlen(p_prog), "");
+    fprintf(stderr, "       %*s [--metrics FILE [--metrics-interval SECS]] [--latency]\n",
+            (int) strlen(p_prog), "");
+    fprintf(stderr, "       %*s [--bench N [--bench-cpu C]] [--remarks FILE] [--debug-info]\n",
+            (int) strlen(p_prog), "");
+    fprintf(stderr, "       %*s [--max-depth N]\n",
+            (int) strlen(p_prog), "");
+    fprintf(stderr, "       %s [-O0|-O1|-O2|-O3] [--jobs N] FILE...\n", p_prog);
+    fprintf(stderr, "       %s [-O0|-O1|-O2|-O3] --procs N [-o FILE] FILE...\n", p_prog);
+    return 1;
+}
+
+/*!
+ * @brief This function reads a count option's value, which must be a whole
+ *          number from 1 to UINT_MAX.
+ *
+ * @return True if the value is valid.
+ */
+static bool
+parse_count (const char * p_text, unsigned& count)
+{
+    char * p_end = nullptr;
+    errno = 0;
+    unsigned long value = strtoul(p_text, &p_end, 10);
+    if (!isdigit((unsigned char) p_text[0]) || *p_end || ERANGE == errno || 0 == value || value > UINT_MAX)
+    {
+        return false;
+    }
+    count = (unsigned) value;
+    return true;
+}
 
-int main ()
+int main (int argc, char ** argv)
 {
+    const char * p_out = "a.out";
+    unsigned jobs = 1;
+    unsigned procs = 0;
+    bool out_of_process = false;
+    unsigned compile_threads = 0;
+    bool whole_program = false;
+    const char * p_metrics = nullptr;
+    double metrics_interval = 15.0;
+    bool print_latency = false;
+    int bench_cpu = -1;
+    const char * p_remarks = nullptr;
+    std::vector<std::string> exports;
+    std::vector<std::string> files;
+
+    // Parse command line options.
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strncmp(argv[i], "-O", 2) && argv[i][2] >= '0' && argv[i][2] <= '3' && !argv[i][3])
+        {
+            g_opt_level = argv[i][2] - '0';
+        }
+        else if (0 == strcmp(argv[i], "--engine") && i + 1 < argc)
+        {
+            const char * p_name = argv[++i];
+            if (0 == strcmp(p_name, "jit"))
+            {
+                g_engine = engine_jit;
+            }
+            else if (0 == strcmp(p_name, "interp"))
+            {
+                g_engine = engine_interp;
+            }
+            else if (0 == strcmp(p_name, "aot"))
+            {
+                g_engine = engine_aot;
+            }
+            else
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--out-of-process"))
+        {
+            out_of_process = true;
+        }
+        else if (0 == strcmp(argv[i], "--speculate") && i + 1 < argc)
+        {
+            compile_threads = (unsigned) atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--demand-codegen"))
+        {
+            g_demand_codegen = true;
+        }
+        else if (0 == strcmp(argv[i], "--whole-program"))
+        {
+            whole_program = true;
+        }
+        else if (0 == strcmp(argv[i], "--export") && i + 1 < argc)
+        {
+            exports.push_back(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--fast-math"))
+        {
+            g_fp_flags.setFast();
+        }
+        else if (0 == strcmp(argv[i], "--fp-contract"))
+        {
+            g_fp_flags.setAllowContract();
+        }
+        else if (0 == strcmp(argv[i], "--fp-reassoc"))
+        {
+            g_fp_flags.setAllowReassoc();
+        }
+        else if (0 == strcmp(argv[i], "--no-simplify"))
+        {
+            g_simplify = false;
+        }
+        else if (0 == strcmp(argv[i], "--metrics") && i + 1 < argc)
+        {
+            p_metrics = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--metrics-interval") && i + 1 < argc)
+        {
+            metrics_interval = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--latency"))
+        {
+            print_latency = true;
+        }
+        else if (0 == strcmp(argv[i], "--bench") && i + 1 < argc)
+        {
+            if (!parse_count(argv[++i], g_bench_runs))
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--bench-cpu") && i + 1 < argc)
+        {
+            bench_cpu = atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--remarks") && i + 1 < argc)
+        {
+            p_remarks = argv[++i];
+            g_remarks = true;
+        }
+        else if (0 == strcmp(argv[i], "--debug-info"))
+        {
+            g_debug_info = true;
+        }
+        else if (0 == strcmp(argv[i], "--max-depth") && i + 1 < argc)
+        {
+            if (!parse_count(argv[++i], max_parse_depth))
+            {
+                return usage(argv[0]);
+            }
+            max_codegen_depth = max_parse_depth;
+        }
+        else if (0 == strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            p_out = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--jobs") && i + 1 < argc)
+        {
+            if (!parse_count(argv[++i], jobs))
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--procs") && i + 1 < argc)
+        {
+            procs = (unsigned) atoi(argv[++i]);
+        }
+        else if ('-' != argv[i][0])
+        {
+            files.push_back(argv[i]);
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+
+    // Export the metrics until, and once more at, exit.
+    if (p_metrics)
+    {
+        if (!metrics_start_exporter(p_metrics, metrics_interval))
+        {
+            return 1;
+        }
+        atexit(metrics_stop_exporter);
+    }
+
+    // Compile files in worker processes and link them together.
+    if (!files.empty() && procs > 0)
+    {
+        BatchStats stats;
+        bool ok = link_files(files, procs, p_out, stats);
+        for (size_t id = 0; id < stats.busy.size(); ++id)
+        {
+            fprintf(stderr, "worker %zu: %.3fs busy, %.0f%% utilized\n",
+                    id, stats.busy[id], stats.wall > 0.0 ? 100.0 * stats.busy[id] / stats.wall : 0.0);
+        }
+        fprintf(stderr, "compile %.3fs, link %.3fs\n", stats.wall, stats.link);
+        return ok ? 0 : 1;
+    }
+
+    // Compile files independently.
+    if (!files.empty())
+    {
+        BatchStats stats;
+        return compile_files(files, jobs, stats) ? 0 : 1;
+    }
+
+    // Name the source in the debug info after the file standard input is
+    // redirected from, if it is one.
+    if (g_debug_info)
+    {
+        char path[PATH_MAX];
+        struct stat st;
+        ssize_t len = readlink("/proc/self/fd/0", path, sizeof(path) - 1);
+        if (len > 0 && 0 == fstat(0, &st) && S_ISREG(st.st_mode))
+        {
+            g_debug_source.assign(path, len);
+        }
+        else
+        {
+            g_debug_source = "<stdin>";
+        }
+    }
+
+    // Warn about the options the chosen engine ignores.
+    if (whole_program && engine_aot != g_engine)
+    {
+        fprintf(stderr, "Warning: --whole-program only applies to the aot engine\n");
+    }
+    if (g_demand_codegen && engine_interp == g_engine)
+    {
+        fprintf(stderr, "Warning: --demand-codegen does not apply to the interp engine\n");
+    }
+
+    // Time the expressions on one core, if asked.
+    if (g_bench_runs && engine_aot == g_engine)
+    {
+        fprintf(stderr, "Error: --bench needs the jit or interp engine\n");
+        return 1;
+    }
+    if (bench_cpu >= 0 && !bench_pin_cpu(bench_cpu))
+    {
+        return 1;
+    }
+
+    // Prepare the target, the JIT and the first module.
+    if (!init_native_target(g_opt_level))
+    {
+        return 1;
+    }
+    if (engine_jit == g_engine && !init_jit(g_opt_level, out_of_process, compile_threads))
+    {
+        return 1;
+    }
+    init_module("kaleidoscope");
+
     // Begin parsing.
     parse();
+
+    if (g_demand_codegen && engine_interp != g_engine)
+    {
+        fprintf(stderr, "Skipped %zu unused definitions\n", g_deferred_functions.size());
+    }
+    if (print_latency)
+    {
+        latency_print(stderr);
+    }
+
+    // An AOT build compiles the whole program once it has all been read.
+    if (engine_aot == g_engine)
+    {
+        llvm::SmallVector<char, 0> object;
+        add_aot_main();
+        if (whole_program)
+        {
+            internalize_module(*g_module, exports);
+        }
+        optimize_module(*g_module, g_opt_level);
+        if (!emit_object(*g_module, object) || !link_object(object, p_out, false))
+        {
+            return 1;
+        }
+    }
+
+    if (p_remarks && !remarks_write(p_remarks))
+    {
+        return 1;
+    }
+
+    // Shut the JIT, and any executor process, down before static
+    // destructors run.
+    g_jit.reset();
+
+    return 0;
 }
 
 /***   end of file   ***/
@@ -0,0 +1,445 @@
+/*!
+ * @file src/metrics.cpp
+ *
+ * @brief This file contains the metrics registry and its exporter.
+ */
+
+#include "metrics.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+thread_local MetricShard * p_metric_shard = nullptr;
+
+// The upper bounds of the histogram buckets, in seconds. A last bucket
+// catches everything above.
+static const double bucket_bounds[] = {
+    1e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1.0, 5.0, 10.0,
+};
+static const unsigned n_bounds = sizeof(bucket_bounds) / sizeof(bucket_bounds[0]);
+
+/*!
+ * @brief This struct holds the registry: every metric, the shards of the
+ *          live threads, and what exited threads had recorded.
+ */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Metric *> metrics;
+    unsigned n_slots = 0;
+    std::vector<MetricShard *> shards;
+    MetricShard retired = {};
+};
+
+/*!
+ * @brief This function returns the registry. It is built on first use, as
+ *          metrics in other files may register before this file's
+ *          statics are initialized.
+ */
+static Registry&
+registry (void)
+{
+    static Registry reg;
+    return reg;
+}
+
+/*!
+ * @brief This struct folds its thread's shard into the retired totals when
+ *          the thread exits.
+ */
+struct ShardOwner
+{
+    MetricShard * p_shard = nullptr;
+
+    ~ShardOwner()
+    {
+        if (!p_shard)
+        {
+            return;
+        }
+
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (unsigned i = 0; i < reg.n_slots; ++i)
+        {
+            reg.retired.slots[i] += p_shard->slots[i].load(std::memory_order_relaxed);
+        }
+        for (auto& p : reg.shards)
+        {
+            if (p == p_shard)
+            {
+                p = reg.shards.back();
+                reg.shards.pop_back();
+                break;
+            }
+        }
+
+        delete p_shard;
+        p_metric_shard = nullptr;
+    }
+};
+
+static thread_local ShardOwner shard_owner;
+
+/*!
+ * @brief This function gives the calling thread a shard.
+ */
+MetricShard *
+metrics_attach_thread (void)
+{
+    MetricShard * p_shard = new MetricShard();
+
+    Registry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.shards.push_back(p_shard);
+    }
+
+    shard_owner.p_shard = p_shard;
+    p_metric_shard = p_shard;
+    return p_shard;
+}
+
+/*!
+ * @brief This function sums one slot over every thread. The registry lock
+ *          must be held.
+ */
+static uint64_t
+slot_total (const Registry& reg, unsigned slot)
+{
+    uint64_t total = reg.retired.slots[slot].load(std::memory_order_relaxed);
+    for (const MetricShard * p_shard : reg.shards)
+    {
+        total += p_shard->slots[slot].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function registers a metric and reserves its slots.
+ */
+Metric::Metric(MetricKind kind,
+               const char * p_name,
+               const char * p_help,
+               const char * p_labels,
+               unsigned n_slots)
+    : kind(kind), p_name(p_name), p_help(p_help), p_labels(p_labels)
+{
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    if (reg.n_slots + n_slots > max_metric_slots)
+    {
+        fprintf(stderr, "Error: too many metrics; %s is not recorded\n", p_name);
+        abort();
+    }
+    slot = reg.n_slots;
+    reg.n_slots += n_slots;
+    reg.metrics.push_back(this);
+}
+
+/*!
+ * @brief This function writes the counter's sample.
+ */
+void
+Counter::write (FILE * p_file) const
+{
+    fprintf(p_file, "%s%s%s%s %llu\n",
+            p_name, p_labels ? "{" : "", p_labels ? p_labels : "", p_labels ? "}" : "",
+            (unsigned long long) slot_total(registry(), slot));
+}
+
+/*!
+ * @brief This function writes the gauge's sample.
+ */
+void
+Gauge::write (FILE * p_file) const
+{
+    fprintf(p_file, "%s %.17g\n", p_name, p_read());
+}
+
+/*!
+ * @brief This function registers a histogram, with a slot per bucket and
+ *          one for the sum in nanoseconds.
+ */
+Histogram::Histogram(const char * p_name, const char * p_help, const char * p_labels)
+    : Metric(metric_histogram, p_name, p_help, p_labels, n_bounds + 2)
+{
+}
+
+/*!
+ * @brief This function records one duration.
+ */
+void
+Histogram::observe (double secs)
+{
+    unsigned bucket = 0;
+    while (bucket < n_bounds && secs > bucket_bounds[bucket])
+    {
+        ++bucket;
+    }
+
+    metric_slot_add(slot + bucket, 1);
+    metric_slot_add(slot + n_bounds + 1, (uint64_t) std::llround(secs * 1e9));
+}
+
+/*!
+ * @brief This function writes the histogram's cumulative buckets, sum and
+ *          count.
+ */
+void
+Histogram::write (FILE * p_file) const
+{
+    const Registry& reg = registry();
+    std::string labels = p_labels ? std::string(p_labels) + "," : "";
+
+    uint64_t count = 0;
+    for (unsigned i = 0; i <= n_bounds; ++i)
+    {
+        count += slot_total(reg, slot + i);
+        if (i < n_bounds)
+        {
+            fprintf(p_file, "%s_bucket{%sle=\"%g\"} %llu\n",
+                    p_name, labels.c_str(), bucket_bounds[i], (unsigned long long) count);
+        }
+        else
+        {
+            fprintf(p_file, "%s_bucket{%sle=\"+Inf\"} %llu\n",
+                    p_name, labels.c_str(), (unsigned long long) count);
+        }
+    }
+
+    const char * p_open = p_labels ? "{" : "";
+    const char * p_close = p_labels ? "}" : "";
+    fprintf(p_file, "%s_sum%s%s%s %.9f\n", p_name, p_open, p_labels ? p_labels : "", p_close,
+            slot_total(reg, slot + n_bounds + 1) / 1e9);
+    fprintf(p_file, "%s_count%s%s%s %llu\n", p_name, p_open, p_labels ? p_labels : "", p_close,
+            (unsigned long long) count);
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function returns the resident set size in bytes.
+ */
+static double
+read_resident_bytes (void)
+{
+    FILE * p_file = fopen("/proc/self/statm", "r");
+    if (!p_file)
+    {
+        return 0.0;
+    }
+
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (2 != fscanf(p_file, "%lu %lu", &size, &resident))
+    {
+        resident = 0;
+    }
+    fclose(p_file);
+
+    return (double) resident * sysconf(_SC_PAGESIZE);
+}
+
+Counter metric_tokens_lexed(
+    "kaleidoscope_tokens_lexed_total", "Tokens read by the lexer."
+);
+Counter metric_defs_parsed(
+    "kaleidoscope_items_parsed_total", "Top-level items parsed, by kind.", "kind=\"def\""
+);
+Counter metric_externs_parsed(
+    "kaleidoscope_items_parsed_total", "Top-level items parsed, by kind.", "kind=\"extern\""
+);
+Counter metric_exprs_parsed(
+    "kaleidoscope_items_parsed_total", "Top-level items parsed, by kind.", "kind=\"expression\""
+);
+Counter metric_parse_errors(
+    "kaleidoscope_parse_errors_total", "Top-level items that failed to parse."
+);
+Counter metric_functions_compiled(
+    "kaleidoscope_functions_compiled_total", "Function bodies generated as IR."
+);
+Counter metric_evaluations(
+    "kaleidoscope_evaluations_total", "Top-level expressions evaluated."
+);
+Histogram metric_compile_seconds(
+    "kaleidoscope_compile_seconds", "Time to codegen, optimize and JIT an item."
+);
+Histogram metric_evaluation_seconds(
+    "kaleidoscope_evaluation_seconds", "Time to run a top-level expression."
+);
+Gauge metric_resident_bytes(
+    "kaleidoscope_resident_memory_bytes", "Resident set size.", read_resident_bytes
+);
+
+/******************************************************************************/
+
+/*!
+ * @brief This function writes every metric in the Prometheus text format.
+ */
+void
+metrics_write (FILE * p_file)
+{
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    static const char * kind_names[] = { "counter", "gauge", "histogram", "summary" };
+    const char * p_last = "";
+    for (const Metric * p_metric : reg.metrics)
+    {
+        if (0 != strcmp(p_last, p_metric->get_name()))
+        {
+            p_last = p_metric->get_name();
+            fprintf(p_file, "# HELP %s %s\n", p_last, p_metric->get_help());
+            fprintf(p_file, "# TYPE %s %s\n", p_last, kind_names[p_metric->get_kind()]);
+        }
+        p_metric->write(p_file);
+    }
+}
+
+/*!
+ * @brief This function writes every metric to a file, through a temporary
+ *          file renamed over it.
+ */
+bool
+metrics_dump (const char * p_path)
+{
+    std::string tmp = std::string(p_path) + ".tmp";
+    FILE * p_file = fopen(tmp.c_str(), "w");
+    if (!p_file)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", tmp.c_str());
+        return false;
+    }
+
+    metrics_write(p_file);
+    bool ok = 0 == fclose(p_file);
+    if (!ok || 0 != rename(tmp.c_str(), p_path))
+    {
+        fprintf(stderr, "Error: cannot write %s\n", p_path);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The exporter thread, and the pipe that wakes it: SIGUSR1 writes a byte to
+// ask for a dump, and metrics_stop_exporter() to ask it to finish.
+static std::thread exporter;
+static int wake_pipe[2] = { -1, -1 };
+static std::atomic<bool> exporter_stopping{ false };
+static std::string export_path;
+static double export_interval = 0.0;
+
+/*!
+ * @brief This function is the SIGUSR1 handler. Writing to a pipe is one of
+ *          the few things a handler may safely do.
+ */
+static void
+on_sigusr1 (int)
+{
+    int saved = errno;
+    char c = 0;
+    ssize_t ignored = write(wake_pipe[1], &c, 1);
+    (void) ignored;
+    errno = saved;
+}
+
+/*!
+ * @brief This function is the body of the exporter thread.
+ */
+static void
+exporter_main (void)
+{
+    int timeout_ms = export_interval > 0.0 ? (int) (export_interval * 1000.0) : -1;
+    for (;;)
+    {
+        struct pollfd pfd = { wake_pipe[0], POLLIN, 0 };
+        int n = poll(&pfd, 1, timeout_ms);
+        if (n > 0)
+        {
+            char buf[64];
+            ssize_t ignored = read(wake_pipe[0], buf, sizeof(buf));
+            (void) ignored;
+        }
+        if (exporter_stopping)
+        {
+            break;
+        }
+        if (n >= 0)
+        {
+            metrics_dump(export_path.c_str());
+        }
+    }
+}
+
+/*!
+ * @brief This function starts the exporter thread.
+ */
+bool
+metrics_start_exporter (const char * p_path, double interval)
+{
+    if (0 != pipe(wake_pipe))
+    {
+        fprintf(stderr, "Error: cannot create the metrics pipe\n");
+        return false;
+    }
+
+    // A handler must never block, even if the thread is slow to drain.
+    fcntl(wake_pipe[1], F_SETFL, fcntl(wake_pipe[1], F_GETFL) | O_NONBLOCK);
+    fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    export_path = p_path;
+    export_interval = interval;
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_sigusr1;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (0 != sigaction(SIGUSR1, &sa, nullptr))
+    {
+        fprintf(stderr, "Error: cannot handle SIGUSR1\n");
+        return false;
+    }
+
+    exporter = std::thread(exporter_main);
+    return true;
+}
+
+/*!
+ * @brief This function writes the metrics a last time and stops the
+ *          exporter thread.
+ */
+void
+metrics_stop_exporter (void)
+{
+    if (!exporter.joinable())
+    {
+        return;
+    }
+
+    exporter_stopping = true;
+    char c = 0;
+    ssize_t ignored = write(wake_pipe[1], &c, 1);
+    (void) ignored;
+    exporter.join();
+
+    signal(SIGUSR1, SIG_IGN);
+    metrics_dump(export_path.c_str());
+}
+
+/***   end of file   ***/
@@ -0,0 +1,202 @@
+/*!
+ * @file src/metrics.hpp
+ *
+ * @brief This file contains the metrics registry: counters, gauges and
+ *          histograms that the compiler updates as it runs, and their
+ *          export in the Prometheus text format.
+ */
+
+#ifndef _LLVM_METRICS_H
+#define _LLVM_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+// The most slots that all counters and histograms together can use.
+static const unsigned max_metric_slots = 128;
+
+/*!
+ * @brief This struct holds one thread's share of every metric. Only its
+ *          thread writes it, so updates need no atomic read-modify-write.
+ */
+struct MetricShard
+{
+    std::atomic<uint64_t> slots[max_metric_slots];
+};
+
+// The calling thread's shard, once it has recorded anything.
+extern thread_local MetricShard * p_metric_shard;
+
+/*!
+ * @brief This function gives the calling thread a shard, the first time it
+ *          records anything. The shard is folded into the totals when the
+ *          thread exits.
+ */
+MetricShard *
+metrics_attach_thread (void);
+
+/*!
+ * @brief This function adds to one slot of the calling thread's shard.
+ */
+static inline void
+metric_slot_add (unsigned slot, uint64_t n)
+{
+    MetricShard * p_shard = p_metric_shard;
+    if (!p_shard)
+    {
+        p_shard = metrics_attach_thread();
+    }
+
+    std::atomic<uint64_t>& s = p_shard->slots[slot];
+    s.store(s.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/*!
+ * @brief This enum contains the kinds of metric.
+ */
+enum MetricKind
+{
+    metric_counter,
+    metric_gauge,
+    metric_histogram,
+    metric_summary,
+};
+
+/*!
+ * @brief This class is the part common to every metric: its name, help
+ *          text and labels, and where its values are kept.
+ *
+ *          Metrics register themselves when constructed, and are written
+ *              out in that order. Those sharing a name, with different
+ *              labels, must be constructed one after the other.
+ */
+class Metric
+{
+protected:
+    MetricKind kind;
+    const char * p_name;
+    const char * p_help;
+    const char * p_labels;      // Such as kind="def", or null.
+    unsigned slot;              // The first slot, for counters and histograms.
+
+    Metric(MetricKind kind,
+           const char * p_name,
+           const char * p_help,
+           const char * p_labels,
+           unsigned n_slots);
+
+public:
+    /*!
+     * @brief This function writes the metric's samples, without its HELP and
+     *          TYPE lines.
+     */
+    virtual void
+    write (FILE * p_file) const = 0;
+
+    MetricKind get_kind() const noexcept { return kind; }
+    const char * get_name() const noexcept { return p_name; }
+    const char * get_help() const noexcept { return p_help; }
+};
+
+/*!
+ * @brief This class is a count that only goes up.
+ */
+class Counter : public Metric
+{
+public:
+    // Ctor.
+    Counter(const char * p_name, const char * p_help, const char * p_labels = nullptr)
+        : Metric(metric_counter, p_name, p_help, p_labels, 1) {}
+
+    void add (uint64_t n = 1) { metric_slot_add(slot, n); }
+
+    void
+    write (FILE * p_file) const override;
+};
+
+/*!
+ * @brief This class is a value read when the metrics are written out, such
+ *          as the memory in use.
+ */
+class Gauge : public Metric
+{
+private:
+    double (*p_read)(void);
+
+public:
+    // Ctor.
+    Gauge(const char * p_name, const char * p_help, double (*p_read)(void))
+        : Metric(metric_gauge, p_name, p_help, nullptr, 0), p_read(p_read) {}
+
+    void
+    write (FILE * p_file) const override;
+};
+
+/*!
+ * @brief This class is a histogram of durations, in seconds, over fixed
+ *          buckets from 10us to 10s.
+ */
+class Histogram : public Metric
+{
+public:
+    // Ctor.
+    Histogram(const char * p_name, const char * p_help, const char * p_labels = nullptr);
+
+    void
+    observe (double secs);
+
+    void
+    write (FILE * p_file) const override;
+};
+
+// The metrics the compiler keeps.
+extern Counter metric_tokens_lexed;
+extern Counter metric_defs_parsed;
+extern Counter metric_externs_parsed;
+extern Counter metric_exprs_parsed;
+extern Counter metric_parse_errors;
+extern Counter metric_functions_compiled;
+extern Counter metric_evaluations;
+extern Histogram metric_compile_seconds;
+extern Histogram metric_evaluation_seconds;
+extern Gauge metric_resident_bytes;
+
+/*!
+ * @brief This function writes every metric in the Prometheus text format.
+ */
+void
+metrics_write (FILE * p_file);
+
+/*!
+ * @brief This function writes every metric to a file, through a temporary
+ *          file renamed over it, so that a reader never sees half of it.
+ *
+ * @return False if the file cannot be written.
+ */
+bool
+metrics_dump (const char * p_path);
+
+/*!
+ * @brief This function starts a thread that writes the metrics to a file
+ *          every interval, and whenever the process receives SIGUSR1.
+ *
+ * @param p_path The file to write, such as one in the node exporter's
+ *              textfile collector directory.
+ * @param interval The seconds between writes, or 0 to write only on SIGUSR1.
+ *
+ * @return False if the thread or the signal handler cannot be set up.
+ */
+bool
+metrics_start_exporter (const char * p_path, double interval);
+
+/*!
+ * @brief This function writes the metrics a last time and stops the
+ *          exporter thread, if it was started.
+ */
+void
+metrics_stop_exporter (void);
+
+#endif // _LLVM_METRICS_H
+
+/***   end of file   ***/
@@ -4,15 +4,48 @@
  * @brief This file contains the functionality of the parser.
  */
 
+#include <chrono>
 #include <map>
 #include <memory>
+#include <set>
 
 #include "parser.hpp"
+#include "benchmark.hpp"
+#include "compiler.hpp"
+#include "debuginfo.hpp"
+#include "jit.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
 
 // This map holds the precedence of binary operators.
-static std::map<char, int> binop_precedence;
+static thread_local std::map<char, int> binop_precedence;
 
-int cur_tok = 0;
+thread_local int cur_tok = 0;
+
+unsigned max_parse_depth = 10000;
+
+// The current nesting of primary expressions.
+static thread_local unsigned parse_depth = 0;
+
+void (*p_item_observer)(const ItemTiming& timing) = nullptr;
+
+// The timing of the item being handled, and the start of its current phase.
+static thread_local ItemTiming item_timing;
+static thread_local double lap_start = 0.0;
+
+/*!
+ * @brief This function returns the seconds since the last lap began, and
+ *          begins the next.
+ */
+static double
+lap (void)
+{
+    using namespace std::chrono;
+    double now = duration<double>(steady_clock::now().time_since_epoch()).count();
+    double elapsed = now - lap_start;
+    lap_start = now;
+    return elapsed;
+}
 
 /*!
  * @brief This function returns the precedence of a given binary operator.
@@ -20,13 +53,23 @@ int cur_tok = 0;
 int
 get_tok_precedence (void)
 {
-    if (!isascii(cur_tok))
+    return get_binop_precedence(cur_tok);
+}
+
+/*!
+ * @brief This function returns the precedence of a token as a binary
+ *          operator.
+ */
+int
+get_binop_precedence (int tok)
+{
+    if (!isascii(tok))
     {
         return -1;
     }
 
     // Make sure it's a declared binary operator.
-    int tok_prec = binop_precedence[cur_tok];
+    int tok_prec = binop_precedence[tok];
     if (tok_prec <= 0)
     {
         return -1;
@@ -113,21 +156,44 @@ parse_identifier_expr (void)
 std::unique_ptr<ExprAST>
 parse_primary (void)
 {
+    // Every level of nesting recurses through here, so bound the stack.
+    if (parse_depth >= max_parse_depth)
+    {
+        return log_error("Expression nested too deeply");
+    }
+
+    // Where the expression begins, for debug info.
+    SourceLocation loc;
+    if (g_debug_info)
+    {
+        loc = lexer_token_loc();
+    }
+
+    std::unique_ptr<ExprAST> result;
+    ++parse_depth;
     switch (cur_tok)
     {
         case tok_identifier:
-            return parse_identifier_expr();
+            result = parse_identifier_expr();
         break;
         case tok_number:
-            return parse_number_expr();
+            result = parse_number_expr();
         break;
         case '(':
-            return parse_paren_expr();
+            result = parse_paren_expr();
         break;
         default:
-            return log_error("Unknown token when expecting an expression");
+            result = log_error("Unknown token when expecting an expression");
         break;
     }
+    --parse_depth;
+
+    // A parenthesized expression keeps the location of what is inside.
+    if (g_debug_info && result)
+    {
+        debug_note_location(result.get(), loc);
+    }
+    return result;
 }
 
 /*!
@@ -171,6 +237,11 @@ parse_binop_rhs (int expr_prec, std::unique_ptr<ExprAST> lhs)
 
         // We now know this is a binary operator.
         int binop = cur_tok;
+        SourceLocation binop_loc;
+        if (g_debug_info)
+        {
+            binop_loc = lexer_token_loc();
+        }
 
         // Consume the operator.
         get_next_token();
@@ -200,6 +271,10 @@ parse_binop_rhs (int expr_prec, std::unique_ptr<ExprAST> lhs)
             std::move(lhs),
             std::move(rhs)
         );
+        if (g_debug_info)
+        {
+            debug_note_location(lhs.get(), binop_loc);
+        }
 
 
     }
@@ -215,7 +290,7 @@ parse_number_expr (void)
 {
     auto result = std::make_unique<NumberExprAST>(num_val);
     get_next_token(); // Consume the number.
-    return std::move(result);
+    return result;
 }
 
 /*!
@@ -262,8 +337,9 @@ parse_prototype (void)
         return log_error_p("Expected function name in prototype");
     }
 
-    // Save the function name.
+    // Save the function name, and where it is.
     std::string func_name = identifier_str;
+    SourceLocation loc = lexer_token_loc();
 
     // Consume the function name.
     get_next_token();
@@ -291,7 +367,7 @@ parse_prototype (void)
     get_next_token();
 
     // Return the new function.
-    return std::make_unique<PrototypeAST>(func_name, std::move(arg_names));
+    return std::make_unique<PrototypeAST>(func_name, std::move(arg_names), loc);
 }
 
 /*!
@@ -307,6 +383,7 @@ parse_definition (void)
     auto proto = parse_prototype();
     if (!proto)
     {
+        metric_parse_errors.add();
         return nullptr;
     }
 
@@ -314,9 +391,11 @@ parse_definition (void)
     auto body = parse_expression();
     if (!body)
     {
+        metric_parse_errors.add();
         return nullptr;
     }
-    
+
+    metric_defs_parsed.add();
     return std::make_unique<FunctionAST>(std::move(proto), std::move(body));
 }
 
@@ -330,7 +409,15 @@ parse_extern (void)
     get_next_token();
 
     // Parse the prototype.
-    return parse_prototype();
+    auto proto = parse_prototype();
+    if (!proto)
+    {
+        metric_parse_errors.add();
+        return nullptr;
+    }
+
+    metric_externs_parsed.add();
+    return proto;
 }
 
 /*!
@@ -340,26 +427,125 @@ std::unique_ptr<FunctionAST>
 parse_top_level_expr (void)
 {
     // Parse the expression.
+    SourceLocation loc = lexer_token_loc();
     auto expr = parse_expression();
     if (!expr)
     {
+        metric_parse_errors.add();
         return nullptr;
     }
+    metric_exprs_parsed.add();
 
-    // Make an anonymous prototype with no name or args.
+    // Make an anonymous prototype with no args.
     auto proto = std::make_unique<PrototypeAST>(
-        "",
-        std::vector<std::string>()
+        "__anon_expr",
+        std::vector<std::string>(),
+        loc
     );
     return std::make_unique<FunctionAST>(std::move(proto), std::move(expr));
 }
 
+/*!
+ * @brief This function records the latency of a handled item, by its kind.
+ *          Parsing is left out: it includes waiting for the input.
+ */
+static void
+record_latency (const ItemTiming& timing)
+{
+    if (!timing.ok)
+    {
+        return;
+    }
+
+    double compile = timing.codegen + timing.optimize + timing.jit;
+    switch (timing.kind)
+    {
+        case tok_def:
+            // Under the evaluator, or demand-driven codegen, nothing compiles.
+            if (timing.codegen > 0.0)
+            {
+                latency_def_compile.record(compile);
+            }
+        break;
+
+        case tok_extern:
+            latency_extern_register.record(timing.codegen);
+        break;
+
+        default:
+            if (engine_interp != g_engine)
+            {
+                latency_expr_compile.record(compile);
+            }
+            if (engine_aot != g_engine)
+            {
+                latency_expr_execute.record(timing.execute);
+            }
+        break;
+    }
+}
+
 void
 handle_definition (void)
 {
-    if (parse_definition())
+    if (auto fn_ast = parse_definition())
     {
-        fprintf(stderr, "Parsed a function definition\n");
+        item_timing.parse = lap();
+
+        // The evaluator keeps the AST itself; nothing is compiled.
+        if (engine_interp == g_engine)
+        {
+            if (g_interp_functions.count(fn_ast->get_name()))
+            {
+                log_error("Function cannot be redefined");
+                return;
+            }
+            fprintf(stderr, "Parsed a function definition\n");
+            g_interp_functions[fn_ast->get_name()] = std::move(fn_ast);
+            item_timing.ok = true;
+            return;
+        }
+
+        // Under demand-driven codegen only the prototype is known for now.
+        if (g_demand_codegen)
+        {
+            // Once generated, a definition is no longer deferred, but its
+            // prototype is marked as defined.
+            const std::string& name = fn_ast->get_name();
+            auto it = g_function_protos.find(name);
+            if (g_deferred_functions.count(name)
+                || (it != g_function_protos.end() && it->second->is_defined()))
+            {
+                log_error("Function cannot be redefined");
+                return;
+            }
+            fprintf(stderr, "Parsed a function definition\n");
+            g_function_protos[name] = std::make_unique<PrototypeAST>(fn_ast->get_proto());
+            g_deferred_functions[name] = std::move(fn_ast);
+            item_timing.ok = true;
+            return;
+        }
+
+        if (fn_ast->codegen())
+        {
+            item_timing.codegen = lap();
+            fprintf(stderr, "Parsed a function definition\n");
+
+            // An AOT build compiles the whole module at the end.
+            if (engine_aot == g_engine)
+            {
+                item_timing.ok = true;
+                return;
+            }
+
+            // Compile the definition in its own module, remembering what
+            // it calls in case it is speculated on later.
+            jit_record_callees(fn_ast->get_name(), fn_ast->get_callees());
+            optimize_module(*g_module, g_opt_level);
+            item_timing.optimize = lap();
+            item_timing.ok = jit_add_module();
+            item_timing.jit = lap();
+        }
     }
     else
     {
@@ -371,9 +557,23 @@ handle_definition (void)
 void
 handle_extern (void)
 {
-    if (parse_extern())
+    if (auto proto_ast = parse_extern())
     {
-        fprintf(stderr, "Parsed an extern\n");
+        item_timing.parse = lap();
+        if (proto_ast->codegen())
+        {
+            item_timing.codegen = lap();
+            fprintf(stderr, "Parsed an extern\n");
+
+            // Declaring a defined function again must not let it be
+            // redefined.
+            auto& recorded = g_function_protos[proto_ast->get_name()];
+            if (!recorded || !recorded->is_defined())
+            {
+                recorded = std::move(proto_ast);
+            }
+            item_timing.ok = true;
+        }
     }
     else
     {
@@ -382,12 +582,176 @@ handle_extern (void)
     }
 }
 
+/*!
+ * @brief This function compiles the deferred definitions the callees can
+ *          reach, under demand-driven codegen. For the JIT they go into a
+ *          module of their own, outliving the expression's.
+ *
+ * @return False if one of them failed to compile.
+ */
+static bool
+codegen_reachable (const std::vector<std::string>& callees)
+{
+    // They stay deferred until they are in the JIT, so that a failure can
+    // leave them waiting to be reached again.
+    std::vector<FunctionAST *> reached;
+    std::set<std::string> seen;
+    std::vector<std::string> pending(callees);
+    while (!pending.empty())
+    {
+        auto it = g_deferred_functions.find(pending.back());
+        pending.pop_back();
+        if (it == g_deferred_functions.end() || !seen.insert(it->first).second)
+        {
+            continue;
+        }
+
+        std::vector<std::string> more = it->second->get_callees();
+        pending.insert(pending.end(), more.begin(), more.end());
+        reached.push_back(it->second.get());
+    }
+
+    if (reached.empty())
+    {
+        return true;
+    }
+
+    bool ok = true;
+    for (FunctionAST * p_fn : reached)
+    {
+        ok = p_fn->codegen() && ok;
+    }
+
+    if (!ok)
+    {
+        // Drop the rest, which may call the one that failed, and leave every
+        // definition undefined again.
+        std::vector<llvm::Function *> generated;
+        for (FunctionAST * p_fn : reached)
+        {
+            if (llvm::Function * p_func = g_module->getFunction(p_fn->get_name()))
+            {
+                p_func->deleteBody();
+                generated.push_back(p_func);
+            }
+            g_function_protos[p_fn->get_name()] = std::make_unique<PrototypeAST>(p_fn->get_proto());
+        }
+        for (llvm::Function * p_func : generated)
+        {
+            if (p_func->use_empty())
+            {
+                p_func->eraseFromParent();
+            }
+        }
+        if (engine_jit == g_engine)
+        {
+            init_module(g_module->getModuleIdentifier());
+        }
+        return false;
+    }
+
+    if (engine_jit == g_engine)
+    {
+        for (FunctionAST * p_fn : reached)
+        {
+            jit_record_callees(p_fn->get_name(), p_fn->get_callees());
+        }
+        optimize_module(*g_module, g_opt_level);
+        if (!jit_add_module())
+        {
+            for (FunctionAST * p_fn : reached)
+            {
+                g_function_protos[p_fn->get_name()] = std::make_unique<PrototypeAST>(p_fn->get_proto());
+            }
+            return false;
+        }
+    }
+
+    for (FunctionAST * p_fn : reached)
+    {
+        g_deferred_functions.erase(std::string(p_fn->get_name()));
+    }
+    return true;
+}
+
 void
 handle_top_level_expression (void)
 {
-    if (parse_top_level_expr())
+    if (auto fn_ast = parse_top_level_expr())
     {
-        fprintf(stderr, "Parsed a top-level expr\n");
+        item_timing.parse = lap();
+
+        // Evaluate by walking the tree.
+        if (engine_interp == g_engine)
+        {
+            double result = fn_ast->evaluate(nullptr);
+            item_timing.execute = lap();
+            item_timing.ok = true;
+            fprintf(stderr, "Evaluated to %f\n", result);
+            if (g_bench_runs)
+            {
+                bench_evaluated(*fn_ast);
+            }
+            return;
+        }
+
+        // Bring in whatever it needs that has not been compiled yet.
+        if (g_demand_codegen && !codegen_reachable(fn_ast->get_callees()))
+        {
+            return;
+        }
+
+        // The expression's callees can compile while it is codegen'd.
+        if (engine_jit == g_engine)
+        {
+            jit_speculate(fn_ast->get_callees());
+        }
+
+        llvm::Function * p_func = fn_ast->codegen();
+        if (p_func && engine_aot == g_engine)
+        {
+            // Keep it under a unique name for the generated main to call.
+            item_timing.codegen = lap();
+            p_func->setName("__anon_expr." + std::to_string(g_aot_entries.size()));
+            g_aot_entries.push_back(p_func->getName().str());
+            item_timing.ok = true;
+        }
+        else if (p_func)
+        {
+            item_timing.codegen = lap();
+
+            // Track the module so its memory can be freed after running.
+            auto rt = g_jit->getMainJITDylib().createResourceTracker();
+            optimize_module(*g_module, g_opt_level);
+            item_timing.optimize = lap();
+            if (g_bench_runs)
+            {
+                bench_warn_folded(*p_func);
+            }
+            if (!jit_add_module(rt))
+            {
+                return;
+            }
+
+            // Run the anonymous function.
+            void * p_fn = jit_lookup("__anon_expr");
+            item_timing.jit = lap();
+            double result;
+            if (p_fn && jit_call(p_fn, nullptr, 0, result))
+            {
+                item_timing.execute = lap();
+                item_timing.ok = true;
+                fprintf(stderr, "Evaluated to %f\n", result);
+                if (g_bench_runs)
+                {
+                    bench_compiled(p_fn);
+                }
+            }
+
+            // Delete the anonymous expression module from the JIT. This
+            // fails only if an out-of-process executor has gone away.
+            jit_remove(std::move(rt));
+        }
     }
     else
     {
@@ -397,16 +761,26 @@ handle_top_level_expression (void)
 }
 
 /*!
- * @brief This is the main parser loop for the parser.
+ * @brief This function installs the standard binary operators and their
+ *          precedence.
  */
 void
-parse (void)
+install_binop_precedence (void)
 {
-    // Install standard binary operators.
     binop_precedence['<'] = 10;
     binop_precedence['+'] = 20;
     binop_precedence['-'] = 30;
     binop_precedence['*'] = 40;
+}
+
+/*!
+ * @brief This is the main parser loop for the parser.
+ */
+void
+parse (void)
+{
+    // Install standard binary operators.
+    install_binop_precedence();
 
     // Prime the first token.
     fprintf(stderr, "ready> ");
@@ -424,20 +798,45 @@ parse (void)
             case ';':
                 // Ignore top-level semicolons.
                 get_next_token();
-            break;
+            continue;
 
             case tok_def:
+                item_timing = ItemTiming();
+                item_timing.kind = tok_def;
+                lap();
                 handle_definition();
             break;
 
             case tok_extern:
+                item_timing = ItemTiming();
+                item_timing.kind = tok_extern;
+                lap();
                 handle_extern();
             break;
 
             default:
+                item_timing = ItemTiming();
+                lap();
                 handle_top_level_expression();
             break;
         }
+
+        // Items that generated code, and expressions that ran.
+        if (item_timing.ok && item_timing.codegen > 0.0)
+        {
+            metric_compile_seconds.observe(item_timing.codegen + item_timing.optimize + item_timing.jit);
+        }
+        if (item_timing.ok && 0 == item_timing.kind && engine_aot != g_engine)
+        {
+            metric_evaluations.add();
+            metric_evaluation_seconds.observe(item_timing.execute);
+        }
+        record_latency(item_timing);
+
+        if (p_item_observer)
+        {
+            p_item_observer(item_timing);
+        }
     }
 }
 
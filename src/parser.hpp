@@ -12,8 +12,34 @@
 #include "ast.hpp"
 #include "lexer.hpp"
 
-// The current token the parser is looking at.
-extern int cur_tok;
+// The current token the parser is looking at. Parser state is per thread.
+extern thread_local int cur_tok;
+
+// The deepest nesting of primary expressions (parentheses and call
+// arguments) the parser will recurse into before reporting an error.
+extern unsigned max_parse_depth;
+
+/*!
+ * @brief This struct holds the time in seconds spent in each phase of one
+ *          top-level item handled by parse().
+ *
+ *          For a definition, jit only covers handing the module over; its
+ *              machine code is generated when a later expression first
+ *              calls it, and is counted in that expression's jit time.
+ */
+struct ItemTiming
+{
+    int kind = 0;           // tok_def, tok_extern, or 0 for an expression.
+    bool ok = false;        // False if the item failed to parse or compile.
+    double parse = 0.0;
+    double codegen = 0.0;
+    double optimize = 0.0;
+    double jit = 0.0;       // Adding to the JIT and looking up the symbol.
+    double execute = 0.0;
+};
+
+// Called with the timing of each item parse() handles, when set.
+extern void (*p_item_observer)(const ItemTiming& timing);
 
 /*!
  * @brief This is the main parser loop for the parser.
@@ -21,12 +47,27 @@ extern int cur_tok;
 void
 parse (void);
 
+/*!
+ * @brief This function installs the standard binary operators and their
+ *          precedence. It is called by parse(), and must be called by any
+ *          other caller of the parse_* functions.
+ */
+void
+install_binop_precedence (void);
+
 /*!
  * @brief This function returns the precedence of a given binary operator.
  */
 int
 get_tok_precedence (void);
 
+/*!
+ * @brief This function returns the precedence of a token as a binary
+ *          operator, or -1 if it is not one.
+ */
+int
+get_binop_precedence (int tok);
+
 /*!
  * @brief This function reads another token from the lexer and updates
  *          cur_tok with its results.
@@ -0,0 +1,633 @@
+/*!
+ * @file src/reassoc.cpp
+ *
+ * @brief This file contains the rewrites that reorder floating point
+ *          arithmetic.
+ */
+
+#include "reassoc.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compiler.hpp"
+
+/*!
+ * @brief This is the shortest chain worth balancing. Three operands take two
+ *          steps either way.
+ */
+static const size_t min_balanced_chain = 4;
+
+/*!
+ * @brief This struct is one term of a sum: either a monomial, a product of
+ *          literals and variables, or any other expression, kept opaque.
+ */
+struct Term
+{
+    std::unique_ptr<ExprAST> * p_slot;      // Where the term is in the tree.
+    bool negative;                          // Whether it is subtracted.
+    bool monomial;
+    double coef;                            // The product of the literals.
+    unsigned factors;                       // The number of leaves multiplied.
+    std::map<std::string, unsigned> powers; // Each variable's exponent.
+};
+
+/******************************************************************************/
+
+/*!
+ * @brief These functions build new nodes.
+ */
+static std::unique_ptr<ExprAST>
+make_binary (char op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs)
+{
+    return std::make_unique<BinaryExprAST>(op, std::move(lhs), std::move(rhs));
+}
+
+static std::unique_ptr<ExprAST>
+make_variable (const std::string& name)
+{
+    return std::make_unique<VariableExprAST>(name);
+}
+
+/*!
+ * @brief This function checks for a binary node with the given operator.
+ */
+static bool
+is_op (const ExprAST * p_expr, char op)
+{
+    return expr_binary == p_expr->get_kind()
+        && op == static_cast<const BinaryExprAST *>(p_expr)->get_op();
+}
+
+/*!
+ * @brief This function counts the operators in an expression.
+ */
+static size_t
+count_ops (const ExprAST * p_expr)
+{
+    size_t ops = 0;
+    std::vector<const ExprAST *> pending = { p_expr };
+    while (!pending.empty())
+    {
+        const ExprAST * p_node = pending.back();
+        pending.pop_back();
+
+        ops += expr_binary == p_node->get_kind();
+        for (size_t i = 0, e = p_node->num_operands(); i != e; ++i)
+        {
+            pending.push_back(p_node->get_operand(i));
+        }
+    }
+
+    return ops;
+}
+
+/*!
+ * @brief This function appends the slots of a node's operands.
+ */
+static void
+push_operands (ExprAST * p_expr, std::vector<std::unique_ptr<ExprAST> *>& out)
+{
+    if (expr_binary == p_expr->get_kind())
+    {
+        BinaryExprAST * p_bin = static_cast<BinaryExprAST *>(p_expr);
+        out.push_back(&p_bin->get_rhs());
+        out.push_back(&p_bin->get_lhs());
+    }
+    else if (expr_call == p_expr->get_kind())
+    {
+        for (auto& arg : static_cast<CallExprAST *>(p_expr)->get_args())
+        {
+            out.push_back(&arg);
+        }
+    }
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function classifies a term, multiplying out its literals and
+ *          counting the exponent of each variable.
+ */
+static Term
+make_term (std::unique_ptr<ExprAST> * p_slot, bool negative)
+{
+    Term term = { p_slot, negative, true, 1.0, 0, {} };
+
+    std::vector<const ExprAST *> pending = { p_slot->get() };
+    while (!pending.empty() && term.monomial)
+    {
+        const ExprAST * p_node = pending.back();
+        pending.pop_back();
+
+        switch (p_node->get_kind())
+        {
+            case expr_number:
+                term.coef *= static_cast<const NumberExprAST *>(p_node)->get_val();
+                ++term.factors;
+            break;
+
+            case expr_variable:
+                ++term.powers[static_cast<const VariableExprAST *>(p_node)->get_name()];
+                ++term.factors;
+            break;
+
+            default:
+                if (is_op(p_node, '*'))
+                {
+                    pending.push_back(p_node->get_operand(1));
+                    pending.push_back(p_node->get_operand(0));
+                }
+                // The simplifier's x+x is still the monomial 2*x.
+                else if (is_op(p_node, '+')
+                         && expr_variable == p_node->get_operand(0)->get_kind()
+                         && expr_variable == p_node->get_operand(1)->get_kind()
+                         && static_cast<const VariableExprAST *>(p_node->get_operand(0))->get_name()
+                            == static_cast<const VariableExprAST *>(p_node->get_operand(1))->get_name())
+                {
+                    term.coef *= 2.0;
+                    ++term.powers[static_cast<const VariableExprAST *>(p_node->get_operand(0))->get_name()];
+                    term.factors += 2;
+                }
+                else
+                {
+                    term.monomial = false;
+                }
+            break;
+        }
+    }
+
+    return term;
+}
+
+/*!
+ * @brief This function returns the chain an operator belongs to: '+' for
+ *          + and -, '*' for *, and 0 for anything else.
+ */
+static char
+chain_family (const ExprAST * p_expr)
+{
+    if (is_op(p_expr, '+') || is_op(p_expr, '-'))
+    {
+        return '+';
+    }
+
+    return is_op(p_expr, '*') ? '*' : 0;
+}
+
+/*!
+ * @brief This function splits a chain of one family into its operands, left
+ *          to right, with whether each is subtracted.
+ */
+static void
+flatten_chain (std::unique_ptr<ExprAST>& root,
+               std::vector<std::pair<std::unique_ptr<ExprAST> *, bool>>& operands)
+{
+    char family = chain_family(root.get());
+
+    std::vector<std::pair<std::unique_ptr<ExprAST> *, bool>> pending = { { &root, false } };
+    while (!pending.empty())
+    {
+        std::unique_ptr<ExprAST> * p_slot = pending.back().first;
+        bool negative = pending.back().second;
+        pending.pop_back();
+
+        if (family == chain_family(p_slot->get()))
+        {
+            BinaryExprAST * p_bin = static_cast<BinaryExprAST *>(p_slot->get());
+            pending.push_back({ &p_bin->get_rhs(), negative != ('-' == p_bin->get_op()) });
+            pending.push_back({ &p_bin->get_lhs(), negative });
+        }
+        else
+        {
+            operands.push_back({ p_slot, negative });
+        }
+    }
+}
+
+/*!
+ * @brief This function splits a sum into its terms, left to right, with the
+ *          sign each is added with.
+ */
+static void
+flatten_sum (std::unique_ptr<ExprAST>& root, std::vector<Term>& terms)
+{
+    // A product on its own is a sum of one term.
+    std::vector<std::pair<std::unique_ptr<ExprAST> *, bool>> operands;
+    if ('+' == chain_family(root.get()))
+    {
+        flatten_chain(root, operands);
+    }
+    else
+    {
+        operands.push_back({ &root, false });
+    }
+
+    for (const auto& operand : operands)
+    {
+        terms.push_back(make_term(operand.first, operand.second));
+    }
+}
+
+/*!
+ * @brief This function appends the parts of an opaque term that are worth
+ *          visiting on their own: the factors of a product that are not
+ *          leaves, or else the term's operands. All of them are inside
+ *          nodes that survive the term being moved.
+ */
+static void
+push_inner (std::unique_ptr<ExprAST>& slot, std::vector<std::unique_ptr<ExprAST> *>& out)
+{
+    if (!is_op(slot.get(), '*'))
+    {
+        push_operands(slot.get(), out);
+        return;
+    }
+
+    std::vector<ExprAST *> products = { slot.get() };
+    while (!products.empty())
+    {
+        BinaryExprAST * p_bin = static_cast<BinaryExprAST *>(products.back());
+        products.pop_back();
+
+        for (std::unique_ptr<ExprAST> * p_factor : { &p_bin->get_lhs(), &p_bin->get_rhs() })
+        {
+            if (is_op(p_factor->get(), '*'))
+            {
+                products.push_back(p_factor->get());
+            }
+            else if (expr_binary == (*p_factor)->get_kind() || expr_call == (*p_factor)->get_kind())
+            {
+                out.push_back(p_factor);
+            }
+        }
+    }
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function builds the coefficient of one power of x: the sum of
+ *          the terms of that degree, with x divided out.
+ *
+ * @return The coefficient, or nullptr if it is zero.
+ */
+static std::unique_ptr<ExprAST>
+build_coefficient (const std::vector<const Term *>& terms, const std::string& x)
+{
+    std::unique_ptr<ExprAST> sum;
+    double literal = 0.0;
+
+    for (const Term * p_term : terms)
+    {
+        double c = p_term->negative ? -p_term->coef : p_term->coef;
+
+        std::unique_ptr<ExprAST> product;
+        for (const auto& power : p_term->powers)
+        {
+            if (power.first == x)
+            {
+                continue;
+            }
+            for (unsigned i = 0; i < power.second; ++i)
+            {
+                product = product
+                    ? make_binary('*', std::move(product), make_variable(power.first))
+                    : make_variable(power.first);
+            }
+        }
+
+        // Literal terms are summed into one.
+        if (!product)
+        {
+            literal += c;
+            continue;
+        }
+
+        bool subtract = sum && -1.0 == c;
+        if (!subtract && 1.0 != c)
+        {
+            product = make_binary('*', std::move(product), std::make_unique<NumberExprAST>(c));
+        }
+        sum = sum ? make_binary(subtract ? '-' : '+', std::move(sum), std::move(product)) : std::move(product);
+    }
+
+    if (0.0 != literal)
+    {
+        std::unique_ptr<ExprAST> number = std::make_unique<NumberExprAST>(literal);
+        sum = sum ? make_binary('+', std::move(sum), std::move(number)) : std::move(number);
+    }
+
+    return sum;
+}
+
+/*!
+ * @brief This function multiplies an expression by x to the given power,
+ *          dropping a literal 1.
+ */
+static std::unique_ptr<ExprAST>
+scale (std::unique_ptr<ExprAST> expr, std::unique_ptr<ExprAST> power)
+{
+    if (expr_number == expr->get_kind() && 1.0 == static_cast<NumberExprAST *>(expr.get())->get_val())
+    {
+        return power;
+    }
+
+    return make_binary('*', std::move(expr), std::move(power));
+}
+
+/*!
+ * @brief This function evaluates the polynomial in Horner form:
+ *          ((c[n]*x + c[n-1])*x + ...)*x + c[0].
+ */
+static std::unique_ptr<ExprAST>
+build_horner (std::vector<std::unique_ptr<ExprAST>>& coefs, const std::string& x)
+{
+    std::unique_ptr<ExprAST> acc = std::move(coefs.back());
+    for (size_t k = coefs.size() - 1; k-- > 0; )
+    {
+        acc = scale(std::move(acc), make_variable(x));
+        if (coefs[k])
+        {
+            acc = make_binary('+', std::move(acc), std::move(coefs[k]));
+        }
+    }
+
+    return acc;
+}
+
+/*!
+ * @brief This function builds x to a power of two by squaring.
+ */
+static std::unique_ptr<ExprAST>
+build_power (const std::string& x, size_t power)
+{
+    if (1 == power)
+    {
+        return make_variable(x);
+    }
+
+    return make_binary('*', build_power(x, power / 2), build_power(x, power / 2));
+}
+
+/*!
+ * @brief This function evaluates the coefficients c[lo..lo+n) with Estrin's
+ *          scheme: the lower and upper halves are evaluated independently
+ *          and joined as low + high*x^h. The recursion is as deep as the
+ *          log of the degree.
+ *
+ * @return The value, or nullptr if every coefficient is zero.
+ */
+static std::unique_ptr<ExprAST>
+build_estrin (std::vector<std::unique_ptr<ExprAST>>& coefs, size_t lo, size_t n, const std::string& x)
+{
+    if (1 == n)
+    {
+        return std::move(coefs[lo]);
+    }
+
+    size_t h = 1;
+    while (h * 2 < n)
+    {
+        h *= 2;
+    }
+
+    std::unique_ptr<ExprAST> low = build_estrin(coefs, lo, h, x);
+    std::unique_ptr<ExprAST> high = build_estrin(coefs, lo + h, n - h, x);
+    if (!high)
+    {
+        return low;
+    }
+
+    high = scale(std::move(high), build_power(x, h));
+    return low ? make_binary('+', std::move(high), std::move(low)) : std::move(high);
+}
+
+/*!
+ * @brief This function rewrites the sum at a slot if it holds a polynomial
+ *          worth rewriting, and appends what is left to visit.
+ */
+static void
+rewrite_sum (std::unique_ptr<ExprAST>& slot, std::vector<std::unique_ptr<ExprAST> *>& roots)
+{
+    std::vector<Term> terms;
+    flatten_sum(slot, terms);
+
+    // The variable of the polynomial is the one raised highest, then the one
+    // in the most terms. The rest are part of the coefficients.
+    std::map<std::string, std::pair<unsigned, unsigned>> usage;
+    size_t old_ops = terms.size() - 1;
+    size_t opaque = 0;
+    for (const Term& term : terms)
+    {
+        if (!term.monomial)
+        {
+            ++opaque;
+            continue;
+        }
+        old_ops += term.factors - 1;
+        for (const auto& power : term.powers)
+        {
+            std::pair<unsigned, unsigned>& u = usage[power.first];
+            u.first = std::max(u.first, power.second);
+            ++u.second;
+        }
+    }
+
+    const std::string * p_x = nullptr;
+    unsigned degree = 0;
+    unsigned uses = 0;
+    for (const auto& u : usage)
+    {
+        if (u.second.first > degree || (u.second.first == degree && u.second.second > uses))
+        {
+            p_x = &u.first;
+            degree = u.second.first;
+            uses = u.second.second;
+        }
+    }
+
+    // Group the monomials by their power of x.
+    std::vector<std::vector<const Term *>> by_degree(degree + 1);
+    for (const Term& term : terms)
+    {
+        if (term.monomial)
+        {
+            auto it = term.powers.find(p_x ? *p_x : std::string());
+            by_degree[it == term.powers.end() ? 0 : it->second].push_back(&term);
+        }
+    }
+
+    auto build_coefficients = [&] (std::vector<std::unique_ptr<ExprAST>>& coefs) {
+        for (const auto& group : by_degree)
+        {
+            coefs.push_back(build_coefficient(group, *p_x));
+        }
+        while (!coefs.empty() && !coefs.back())
+        {
+            coefs.pop_back();
+        }
+    };
+
+    // Only a polynomial of degree 2 or more has multiplies to save.
+    std::unique_ptr<ExprAST> poly;
+    size_t n_coefs = 0;
+    if (degree >= 2)
+    {
+        std::vector<std::unique_ptr<ExprAST>> coefs;
+        build_coefficients(coefs);
+        n_coefs = coefs.size();
+        if (n_coefs > 2)
+        {
+            poly = build_horner(coefs, *p_x);
+        }
+    }
+
+    if (!poly || count_ops(poly.get()) + opaque >= old_ops)
+    {
+        for (Term& term : terms)
+        {
+            if (!term.monomial)
+            {
+                push_inner(*term.p_slot, roots);
+            }
+        }
+        return;
+    }
+
+    // Estrin takes more multiplies as written, but once optimization has
+    // merged the repeated powers its shorter dependency chain wins.
+    if (n_coefs > 4 && g_opt_level >= 1)
+    {
+        std::vector<std::unique_ptr<ExprAST>> coefs;
+        build_coefficients(coefs);
+        poly = build_estrin(coefs, 0, coefs.size(), *p_x);
+    }
+
+    // Add the opaque terms back after the polynomial, in their order.
+    for (Term& term : terms)
+    {
+        if (!term.monomial)
+        {
+            push_inner(*term.p_slot, roots);
+            poly = make_binary(term.negative ? '-' : '+', std::move(poly), std::move(*term.p_slot));
+        }
+    }
+
+    slot = std::move(poly);
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function joins the operands [lo, lo+n) into a balanced tree.
+ *          Each subtree is returned with the sign of its first operand, so
+ *          that the operands keep their order, and with it the order of
+ *          any calls among them. The recursion is as deep as the log of the
+ *          chain's length.
+ */
+static std::unique_ptr<ExprAST>
+build_balanced (std::vector<std::pair<std::unique_ptr<ExprAST>, bool>>& operands,
+                size_t lo, size_t n, char family, bool& negative)
+{
+    if (1 == n)
+    {
+        negative = operands[lo].second;
+        return std::move(operands[lo].first);
+    }
+
+    bool l_negative = false;
+    bool r_negative = false;
+    std::unique_ptr<ExprAST> lhs = build_balanced(operands, lo, n / 2, family, l_negative);
+    std::unique_ptr<ExprAST> rhs = build_balanced(operands, lo + n / 2, n - n / 2, family, r_negative);
+
+    // With the left half's sign taken out: -l + r is -(l - r), -l - r is
+    // -(l + r).
+    negative = l_negative;
+    char op = '*' == family ? '*' : l_negative == r_negative ? '+' : '-';
+
+    return make_binary(op, std::move(lhs), std::move(rhs));
+}
+
+/******************************************************************************/
+
+void
+rewrite_polynomials (std::unique_ptr<ExprAST>& body)
+{
+    // Visit top down, so that each sum is taken whole rather than in pieces.
+    std::vector<std::unique_ptr<ExprAST> *> roots = { &body };
+    while (!roots.empty())
+    {
+        std::unique_ptr<ExprAST> * p_slot = roots.back();
+        roots.pop_back();
+
+        if (is_op(p_slot->get(), '+') || is_op(p_slot->get(), '-') || is_op(p_slot->get(), '*'))
+        {
+            rewrite_sum(*p_slot, roots);
+        }
+        else
+        {
+            push_operands(p_slot->get(), roots);
+        }
+    }
+}
+
+void
+balance_chains (std::unique_ptr<ExprAST>& body)
+{
+    // Visit bottom up, noting the family of each node's parent: a chain is
+    // taken whole at its top node, the first whose parent differs.
+    struct Visit
+    {
+        std::unique_ptr<ExprAST> * p_slot;
+        char parent;
+        bool expanded;
+    };
+
+    std::vector<Visit> pending = { { &body, 0, false } };
+    while (!pending.empty())
+    {
+        Visit visit = pending.back();
+        pending.pop_back();
+        char family = chain_family(visit.p_slot->get());
+
+        if (!visit.expanded)
+        {
+            pending.push_back({ visit.p_slot, visit.parent, true });
+
+            std::vector<std::unique_ptr<ExprAST> *> operands;
+            push_operands(visit.p_slot->get(), operands);
+            for (std::unique_ptr<ExprAST> * p_operand : operands)
+            {
+                pending.push_back({ p_operand, family, false });
+            }
+            continue;
+        }
+
+        if (!family || family == visit.parent)
+        {
+            continue;
+        }
+
+        std::vector<std::pair<std::unique_ptr<ExprAST> *, bool>> slots;
+        flatten_chain(*visit.p_slot, slots);
+        if (slots.size() < min_balanced_chain)
+        {
+            continue;
+        }
+
+        std::vector<std::pair<std::unique_ptr<ExprAST>, bool>> operands;
+        for (const auto& slot : slots)
+        {
+            operands.push_back({ std::move(*slot.first), slot.second });
+        }
+
+        // The first operand of a chain is never subtracted.
+        bool negative = false;
+        *visit.p_slot = build_balanced(operands, 0, operands.size(), family, negative);
+    }
+}
+
+/***   end of file   ***/
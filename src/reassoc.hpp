@@ -0,0 +1,47 @@
+/*!
+ * @file src/reassoc.hpp
+ *
+ * @brief This file contains the rewrites that reorder floating point
+ *          arithmetic. They change rounding, so they only run when
+ *          g_fp_flags allows reassociation.
+ */
+
+#ifndef _LLVM_REASSOC_H
+#define _LLVM_REASSOC_H
+
+#include <memory>
+
+#include "ast.hpp"
+
+/*!
+ * @brief This function rewrites each sum of monomials in one variable, such
+ *          as "a*x*x*x + b*x*x + c*x + d", into Horner form, or into
+ *          Estrin's scheme from degree 4 when optimizing, where the
+ *          repeated powers of x are merged and the two halves of each
+ *          split evaluate in parallel. Each step is a multiply feeding an
+ *          add, which becomes an FMA when contraction is also allowed.
+ *
+ *          A sum is only rewritten if that takes fewer operations. Terms
+ *              that are not monomials, such as calls, are kept and added
+ *              after the polynomial, in their original order.
+ *
+ * @param body The expression to rewrite in place.
+ */
+void
+rewrite_polynomials (std::unique_ptr<ExprAST>& body);
+
+/*!
+ * @brief This function rebalances each chain of four or more operands of one
+ *          associative operator, such as the left-deep "a+b+c+d" the parser
+ *          builds, into a tree of logarithmic height, so that its
+ *          operations no longer wait on each other one by one. Subtraction
+ *          is part of the + chain. The operands keep their order.
+ *
+ * @param body The expression to rewrite in place.
+ */
+void
+balance_chains (std::unique_ptr<ExprAST>& body);
+
+#endif // _LLVM_REASSOC_H
+
+/***   end of file   ***/
@@ -0,0 +1,366 @@
+/*!
+ * @file src/remarks.cpp
+ *
+ * @brief This file contains the collection of LLVM's optimization remarks,
+ *          summarized per definition.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "remarks.hpp"
+
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+
+bool g_remarks = false;
+
+// The passes whose remarks are kept, and whether their analysis remarks,
+// which explain a missed optimization, are kept too.
+static const struct
+{
+    const char * p_pass;
+    bool analysis;
+} remark_passes[] =
+{
+    { "inline",         false },
+    { "loop-vectorize", true  },
+    { "slp-vectorizer", true  },
+    { "licm",           false },
+    { "gvn",            false },
+};
+
+// Top-level expressions share these names, with a suffix where renamed.
+static const char * anon_prefix = "__anon_expr";
+
+/*!
+ * @brief This enum contains the kinds of remark.
+ */
+enum RemarkKind
+{
+    remark_applied,
+    remark_missed,
+    remark_analysis,
+};
+
+static const char * remark_kind_names[] = { "applied", "missed", "analysis" };
+
+/*!
+ * @brief This struct identifies one remark; the same remark from another
+ *          module is counted rather than kept again.
+ */
+struct RemarkKey
+{
+    RemarkKind kind;
+    std::string pass;
+    std::string name;
+    SourceLocation loc;
+    std::string message;
+
+    bool
+    operator< (const RemarkKey& other) const
+    {
+        return std::tie(loc.line, loc.col, kind, pass, name, message)
+             < std::tie(other.loc.line, other.loc.col, other.kind, other.pass, other.name, other.message);
+    }
+};
+
+/*!
+ * @brief This struct holds the remarks on one definition, on all the
+ *          top-level expressions, or on a function the compiler made, such
+ *          as an AOT build's main.
+ */
+struct DefinitionRemarks
+{
+    std::string title;
+    SourceLocation loc;
+    std::map<RemarkKey, unsigned> counts;
+};
+
+/*!
+ * @brief This struct holds every remark collected, from any thread.
+ */
+struct RemarkLog
+{
+    std::mutex mutex;
+    std::vector<DefinitionRemarks> defs;
+    std::map<std::string, size_t> index;    // By function name.
+};
+
+static RemarkLog remark_log;
+
+/*!
+ * @brief This function returns whether a function is a top-level expression.
+ */
+static bool
+is_anon (const std::string& fn_name)
+{
+    return 0 == fn_name.compare(0, strlen(anon_prefix), anon_prefix);
+}
+
+/*!
+ * @brief This function returns the entry for a function's remarks, adding
+ *          it if needed. The caller holds the log's lock.
+ */
+static DefinitionRemarks&
+entry_for (const std::string& fn_name)
+{
+    const std::string key = is_anon(fn_name) ? anon_prefix : fn_name;
+
+    auto it = remark_log.index.find(key);
+    if (it != remark_log.index.end())
+    {
+        return remark_log.defs[it->second];
+    }
+
+    remark_log.index[key] = remark_log.defs.size();
+    remark_log.defs.push_back(DefinitionRemarks());
+    remark_log.defs.back().title = is_anon(fn_name) ? "top-level expressions" : fn_name;
+    return remark_log.defs.back();
+}
+
+/*!
+ * @brief This class receives a context's diagnostics, keeps the remarks of
+ *          the passes of interest, and leaves the rest to LLVM.
+ */
+class RemarkCollector : public llvm::DiagnosticHandler
+{
+private:
+    static bool
+    is_kept (llvm::StringRef pass, bool analysis)
+    {
+        for (const auto& p : remark_passes)
+        {
+            if (pass == p.p_pass)
+            {
+                return !analysis || p.analysis;
+            }
+        }
+        return false;
+    }
+
+public:
+    bool isAnyRemarkEnabled() const override { return true; }
+    bool isPassedOptRemarkEnabled(llvm::StringRef pass) const override { return is_kept(pass, false); }
+    bool isMissedOptRemarkEnabled(llvm::StringRef pass) const override { return is_kept(pass, false); }
+    bool isAnalysisRemarkEnabled(llvm::StringRef pass) const override { return is_kept(pass, true); }
+
+    bool
+    handleDiagnostics (const llvm::DiagnosticInfo& di) override;
+};
+
+/*!
+ * @brief This function records a remark, and reports any other diagnostic
+ *          as unhandled.
+ */
+bool
+RemarkCollector::handleDiagnostics (const llvm::DiagnosticInfo& di)
+{
+    const auto * p_remark = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&di);
+    if (!p_remark)
+    {
+        return false;
+    }
+
+    RemarkKey key;
+    switch (di.getKind())
+    {
+        case llvm::DK_OptimizationRemark:
+            key.kind = remark_applied;
+        break;
+
+        case llvm::DK_OptimizationRemarkMissed:
+            key.kind = remark_missed;
+        break;
+
+        default:
+            key.kind = remark_analysis;
+        break;
+    }
+    if (!is_kept(p_remark->getPassName(), remark_analysis == key.kind))
+    {
+        return true;
+    }
+
+    key.pass = p_remark->getPassName().str();
+    key.name = p_remark->getRemarkName().str();
+    key.message = p_remark->getMsg();
+    if (p_remark->isLocationAvailable())
+    {
+        key.loc.line = p_remark->getLocation().getLine();
+        key.loc.col = p_remark->getLocation().getColumn();
+    }
+
+    std::lock_guard<std::mutex> lock(remark_log.mutex);
+    ++entry_for(p_remark->getFunction().getName().str()).counts[key];
+    return true;
+}
+
+/*!
+ * @brief This function installs the remark collector on a context.
+ */
+void
+remarks_attach (llvm::LLVMContext& context)
+{
+    context.setDiagnosticHandler(std::make_unique<RemarkCollector>());
+}
+
+/*!
+ * @brief This function records where a definition begins. The top-level
+ *          expressions are grouped, so have no one location.
+ */
+void
+remarks_note_definition (const PrototypeAST& proto)
+{
+    if (is_anon(proto.get_name()))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(remark_log.mutex);
+    DefinitionRemarks& def = entry_for(proto.get_name());
+    def.title = "def " + proto.get_name();
+    if (!def.loc.line)
+    {
+        def.loc = proto.get_loc();
+    }
+}
+
+/*!
+ * @brief This function returns a message as a double-quoted YAML scalar.
+ */
+static std::string
+yaml_quote (const std::string& text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        if ('"' == c || '\\' == c)
+        {
+            out += '\\';
+        }
+        if ('\n' == c)
+        {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+/*!
+ * @brief This function writes the remarks as YAML: a list of definitions,
+ *          each with its location and remarks.
+ */
+static void
+write_yaml (FILE * p_file)
+{
+    for (const auto& def : remark_log.defs)
+    {
+        fprintf(p_file, "- definition: %s\n", yaml_quote(def.title).c_str());
+        if (def.loc.line)
+        {
+            fprintf(p_file, "  line: %u\n  column: %u\n", def.loc.line, def.loc.col);
+        }
+        fprintf(p_file, "  remarks:%s\n", def.counts.empty() ? " []" : "");
+        for (const auto& r : def.counts)
+        {
+            const RemarkKey& key = r.first;
+            fprintf(p_file, "    - kind: %s\n", remark_kind_names[key.kind]);
+            fprintf(p_file, "      pass: %s\n", key.pass.c_str());
+            fprintf(p_file, "      name: %s\n", key.name.c_str());
+            if (key.loc.line)
+            {
+                fprintf(p_file, "      line: %u\n      column: %u\n", key.loc.line, key.loc.col);
+            }
+            fprintf(p_file, "      count: %u\n", r.second);
+            fprintf(p_file, "      message: %s\n", yaml_quote(key.message).c_str());
+        }
+    }
+}
+
+/*!
+ * @brief This function writes the remarks as a readable report: per
+ *          definition, how many were applied and missed, then each remark.
+ */
+static void
+write_report (FILE * p_file)
+{
+    for (const auto& def : remark_log.defs)
+    {
+        unsigned n[3] = { 0, 0, 0 };
+        for (const auto& r : def.counts)
+        {
+            n[r.first.kind] += r.second;
+        }
+
+        fprintf(p_file, "%s", def.title.c_str());
+        if (def.loc.line)
+        {
+            fprintf(p_file, " (line %u:%u)", def.loc.line, def.loc.col);
+        }
+        fprintf(p_file, ": %u applied, %u missed\n", n[remark_applied], n[remark_missed]);
+
+        for (const auto& r : def.counts)
+        {
+            const RemarkKey& key = r.first;
+            char where[32] = "";
+            if (key.loc.line)
+            {
+                snprintf(where, sizeof(where), "%u:%u", key.loc.line, key.loc.col);
+            }
+            fprintf(p_file, "  %-8s %-14s %-7s %s", remark_kind_names[key.kind],
+                    key.pass.c_str(), where, key.message.c_str());
+            if (r.second > 1)
+            {
+                fprintf(p_file, " (x%u)", r.second);
+            }
+            fprintf(p_file, "\n");
+        }
+    }
+}
+
+/*!
+ * @brief This function writes the remarks to a file or stderr.
+ */
+bool
+remarks_write (const char * p_path)
+{
+    std::lock_guard<std::mutex> lock(remark_log.mutex);
+
+    if (0 == strcmp(p_path, "-"))
+    {
+        write_report(stderr);
+        return true;
+    }
+
+    FILE * p_file = fopen(p_path, "w");
+    if (!p_file)
+    {
+        fprintf(stderr, "Error: Cannot write %s: %s\n", p_path, strerror(errno));
+        return false;
+    }
+
+    size_t len = strlen(p_path);
+    bool yaml = (len > 5 && 0 == strcmp(p_path + len - 5, ".yaml"))
+             || (len > 4 && 0 == strcmp(p_path + len - 4, ".yml"));
+    if (yaml)
+    {
+        write_yaml(p_file);
+    }
+    else
+    {
+        write_report(p_file);
+    }
+
+    return 0 == fclose(p_file);
+}
+
+/***   end of file   ***/
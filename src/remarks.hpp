@@ -0,0 +1,45 @@
+/*!
+ * @file src/remarks.hpp
+ *
+ * @brief This file contains the collection of LLVM's optimization remarks,
+ *          summarized per definition.
+ */
+
+#ifndef _LLVM_REMARKS_H
+#define _LLVM_REMARKS_H
+
+#include "ast.hpp"
+
+// Whether remarks are collected from every module's pipeline.
+extern bool g_remarks;
+
+/*!
+ * @brief This function installs the remark collector on a context, so that
+ *          the inlining, vectorization, LICM and GVN remarks of modules
+ *          optimized in it are kept.
+ */
+void
+remarks_attach (llvm::LLVMContext& context);
+
+/*!
+ * @brief This function records where a definition begins, for remarks on
+ *          its function that carry no location of their own.
+ */
+void
+remarks_note_definition (const PrototypeAST& proto);
+
+/*!
+ * @brief This function writes the remarks, grouped by definition in the
+ *          order they were compiled, with repeats counted once.
+ *
+ * @param p_path The file to write: YAML if it ends in ".yaml" or ".yml", a
+ *              readable report otherwise, or "-" for a report on stderr.
+ *
+ * @return False if the file cannot be written.
+ */
+bool
+remarks_write (const char * p_path);
+
+#endif // _LLVM_REMARKS_H
+
+/***   end of file   ***/
@@ -0,0 +1,362 @@
+/*!
+ * @file src/simplify.cpp
+ *
+ * @brief This file contains the algebraic simplification pass.
+ *
+ *          The pass rewrites the AST rather than the IR so that the O0 and
+ *              REPL paths, where LLVM does no cleanup, emit less IR, and
+ *              every later pass has less to chew through.
+ */
+
+#include "simplify.hpp"
+
+#include <cmath>
+#include <vector>
+
+/*!
+ * @brief This flag turns the pass on for every function body.
+ */
+bool g_simplify = true;
+
+/******************************************************************************/
+
+/*!
+ * @brief This function checks for a numeric literal of the given value,
+ *          telling +0 and -0 apart.
+ */
+static bool
+is_number (const ExprAST * p_expr, double val)
+{
+    if (expr_number != p_expr->get_kind())
+    {
+        return false;
+    }
+
+    double v = static_cast<const NumberExprAST *>(p_expr)->get_val();
+    return v == val && std::signbit(v) == std::signbit(val);
+}
+
+/*!
+ * @brief This function checks for a reference to a variable, and if a name is
+ *          given, to that variable.
+ */
+static bool
+is_variable (const ExprAST * p_expr, const std::string * p_name = nullptr)
+{
+    if (expr_variable != p_expr->get_kind())
+    {
+        return false;
+    }
+
+    return !p_name || static_cast<const VariableExprAST *>(p_expr)->get_name() == *p_name;
+}
+
+/*!
+ * @brief This function checks that an expression calls nothing, so that
+ *          dropping it cannot drop a side effect.
+ */
+static bool
+is_pure (const ExprAST * p_expr)
+{
+    std::vector<const ExprAST *> pending = { p_expr };
+    while (!pending.empty())
+    {
+        const ExprAST * p_node = pending.back();
+        pending.pop_back();
+
+        if (expr_call == p_node->get_kind())
+        {
+            return false;
+        }
+        for (size_t i = 0, e = p_node->num_operands(); i != e; ++i)
+        {
+            pending.push_back(p_node->get_operand(i));
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * @brief This function orders the operands of + and *: literals go last,
+ *          then variables, then everything else. Only the first two are
+ *          moved, so no call changes places with another.
+ */
+static int
+operand_rank (const ExprAST * p_expr)
+{
+    switch (p_expr->get_kind())
+    {
+        case expr_number:
+            return 2;
+        break;
+
+        case expr_variable:
+            return 1;
+        break;
+
+        default:
+            return 0;
+        break;
+    }
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function applies one rewrite to a binary operator.
+ *
+ * @return True if the node was rewritten.
+ */
+static bool
+rewrite_binary (std::unique_ptr<ExprAST>& slot)
+{
+    BinaryExprAST * p_bin = static_cast<BinaryExprAST *>(slot.get());
+    char op = p_bin->get_op();
+    std::unique_ptr<ExprAST>& lhs = p_bin->get_lhs();
+    std::unique_ptr<ExprAST>& rhs = p_bin->get_rhs();
+
+    // Fold literals; the results are exactly what the IR would compute.
+    if (expr_number == lhs->get_kind() && expr_number == rhs->get_kind())
+    {
+        double l = static_cast<NumberExprAST *>(lhs.get())->get_val();
+        double r = static_cast<NumberExprAST *>(rhs.get())->get_val();
+        double v;
+        switch (op)
+        {
+            case '+':
+                v = l + r;
+            break;
+
+            case '-':
+                v = l - r;
+            break;
+
+            case '*':
+                v = l * r;
+            break;
+
+            // Unordered or less than, as the emitted comparison is.
+            case '<':
+                v = !(l >= r) ? 1.0 : 0.0;
+            break;
+
+            default:
+                return false;
+            break;
+        }
+
+        slot = std::make_unique<NumberExprAST>(v);
+        return true;
+    }
+
+    // Canonicalize commutative operands.
+    if ('+' == op || '*' == op)
+    {
+        int l_rank = operand_rank(lhs.get());
+        int r_rank = operand_rank(rhs.get());
+        if (l_rank > r_rank
+            || (1 == l_rank && 1 == r_rank
+                && static_cast<VariableExprAST *>(lhs.get())->get_name()
+                   > static_cast<VariableExprAST *>(rhs.get())->get_name()))
+        {
+            std::swap(lhs, rhs);
+            return true;
+        }
+    }
+
+    std::unique_ptr<ExprAST> result;
+    switch (op)
+    {
+        case '*':
+            if (is_number(rhs.get(), 1.0))
+            {
+                result = std::move(lhs);
+            }
+            else if (is_number(rhs.get(), 2.0) && is_variable(lhs.get()))
+            {
+                const std::string& name = static_cast<VariableExprAST *>(lhs.get())->get_name();
+                result = std::make_unique<BinaryExprAST>(
+                    '+',
+                    std::make_unique<VariableExprAST>(name),
+                    std::move(lhs)
+                );
+            }
+            else if ((is_number(rhs.get(), 0.0) || is_number(rhs.get(), -0.0))
+                     && g_fp_flags.noNaNs() && g_fp_flags.noInfs() && g_fp_flags.noSignedZeros()
+                     && is_pure(lhs.get()))
+            {
+                result = std::make_unique<NumberExprAST>(0.0);
+            }
+        break;
+
+        case '+':
+            if (is_number(rhs.get(), -0.0)
+                || (is_number(rhs.get(), 0.0) && g_fp_flags.noSignedZeros()))
+            {
+                result = std::move(lhs);
+            }
+        break;
+
+        case '-':
+            if (is_number(rhs.get(), 0.0)
+                || (is_number(rhs.get(), -0.0) && g_fp_flags.noSignedZeros()))
+            {
+                result = std::move(lhs);
+            }
+            else if (is_variable(lhs.get())
+                     && is_variable(rhs.get(), &static_cast<VariableExprAST *>(lhs.get())->get_name())
+                     && g_fp_flags.noNaNs() && g_fp_flags.noInfs())
+            {
+                result = std::make_unique<NumberExprAST>(0.0);
+            }
+        break;
+
+        default:
+        break;
+    }
+
+    if (!result)
+    {
+        return false;
+    }
+
+    slot = std::move(result);
+    return true;
+}
+
+/*!
+ * @brief This function tells whether "pow" is libm's: declared by an extern,
+ *          with no body of the program's own, compiled or deferred.
+ */
+static bool
+pow_is_libm (void)
+{
+    auto it = g_function_protos.find("pow");
+    return it != g_function_protos.end()
+        && !it->second->is_defined()
+        && !g_deferred_functions.count("pow");
+}
+
+/*!
+ * @brief This function expands a call to libm's pow with a small integer
+ *          exponent into multiplies.
+ *
+ * @param libm_pow Whether "pow" is libm's.
+ *
+ * @return True if the node was rewritten.
+ */
+static bool
+rewrite_call (std::unique_ptr<ExprAST>& slot, bool libm_pow)
+{
+    CallExprAST * p_call = static_cast<CallExprAST *>(slot.get());
+    std::vector<std::unique_ptr<ExprAST>>& args = p_call->get_args();
+
+    // Only an extern "pow", and only over a variable, which can be repeated.
+    if ("pow" != p_call->get_callee()
+        || 2 != args.size()
+        || !libm_pow
+        || !is_variable(args[0].get())
+        || expr_number != args[1]->get_kind())
+    {
+        return false;
+    }
+
+    double n = static_cast<NumberExprAST *>(args[1].get())->get_val();
+    const std::string& name = static_cast<VariableExprAST *>(args[0].get())->get_name();
+
+    // Up to a square the result is exact; beyond, each multiply rounds.
+    int max_n = g_fp_flags.approxFunc() ? 4 : 2;
+    if (n != std::floor(n) || n < 0 || n > max_n)
+    {
+        return false;
+    }
+
+    std::unique_ptr<ExprAST> result;
+    if (0 == n)
+    {
+        result = std::make_unique<NumberExprAST>(1.0);
+    }
+    else
+    {
+        result = std::move(args[0]);
+        for (int i = 1; i < (int) n; ++i)
+        {
+            result = std::make_unique<BinaryExprAST>(
+                '*',
+                std::move(result),
+                std::make_unique<VariableExprAST>(name)
+            );
+        }
+    }
+
+    slot = std::move(result);
+    return true;
+}
+
+/******************************************************************************/
+
+void
+simplify_function (const std::string& name, std::unique_ptr<ExprAST>& body)
+{
+    // A "pow" being defined is the program's own.
+    bool libm_pow = "pow" != name && pow_is_libm();
+
+    // Rewrite bottom up, with an explicit stack as codegen does, so that each
+    // node sees its operands in their final form.
+    struct Visit
+    {
+        std::unique_ptr<ExprAST> * p_slot;
+        bool expanded;
+    };
+
+    std::vector<Visit> pending = { { &body, false } };
+    while (!pending.empty())
+    {
+        Visit visit = pending.back();
+        pending.pop_back();
+        ExprAST * p_node = visit.p_slot->get();
+
+        if (!visit.expanded)
+        {
+            pending.push_back({ visit.p_slot, true });
+            if (expr_binary == p_node->get_kind())
+            {
+                BinaryExprAST * p_bin = static_cast<BinaryExprAST *>(p_node);
+                pending.push_back({ &p_bin->get_rhs(), false });
+                pending.push_back({ &p_bin->get_lhs(), false });
+            }
+            else if (expr_call == p_node->get_kind())
+            {
+                for (auto& arg : static_cast<CallExprAST *>(p_node)->get_args())
+                {
+                    pending.push_back({ &arg, false });
+                }
+            }
+            continue;
+        }
+
+        // A rewrite can enable another at the same node, such as x*2 once
+        // 2*x has been canonicalized.
+        bool changed = true;
+        while (changed)
+        {
+            switch ((*visit.p_slot)->get_kind())
+            {
+                case expr_binary:
+                    changed = rewrite_binary(*visit.p_slot);
+                break;
+
+                case expr_call:
+                    changed = rewrite_call(*visit.p_slot, libm_pow);
+                break;
+
+                default:
+                    changed = false;
+                break;
+            }
+        }
+    }
+}
+
+/***   end of file   ***/
@@ -0,0 +1,40 @@
+/*!
+ * @file src/simplify.hpp
+ *
+ * @brief This file contains the algebraic simplification pass that runs
+ *          over a function body before its IR is emitted.
+ */
+
+#ifndef _LLVM_SIMPLIFY_H
+#define _LLVM_SIMPLIFY_H
+
+#include <memory>
+#include <string>
+
+#include "ast.hpp"
+
+// Whether function bodies are simplified before codegen; on by default.
+extern bool g_simplify;
+
+/*!
+ * @brief This function rewrites a function body in place into a cheaper
+ *          expression with the same value.
+ *
+ *          Rewrites that are exact in IEEE arithmetic always apply: constant
+ *              folding, x*1, x+(-0), x-0, x*2 to x+x, pow(x, n) for n in
+ *              0..2, and moving constants and variables to the right of
+ *              + and *. The rest wait for the matching g_fp_flags: x+0
+ *              needs no-signed-zeros, x-x and 0*x need no-NaNs and no-infs
+ *              as well, and pow(x, 3) and pow(x, 4) need approximate
+ *              functions.
+ *
+ * @param name The name of the function, so that calls to a "pow" the program
+ *              defines itself are left alone.
+ * @param body The body to rewrite.
+ */
+void
+simplify_function (const std::string& name, std::unique_ptr<ExprAST>& body);
+
+#endif // _LLVM_SIMPLIFY_H
+
+/***   end of file   ***/
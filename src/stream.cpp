@@ -0,0 +1,346 @@
+/*!
+ * @file src/stream.cpp
+ *
+ * @brief This file contains the resumable parser.
+ */
+
+#include <cctype>
+
+#include "stream.hpp"
+#include "parser.hpp"
+
+// The consumed prefix is only dropped once it is at least this long, so that
+// small chunks do not each move the buffer.
+static const size_t min_compact_bytes = 256;
+
+/*!
+ * @brief This function returns the token kind of an identifier, telling the
+ *          keywords apart.
+ */
+static int
+identifier_kind (const std::string& buf, size_t begin, size_t end)
+{
+    if (0 == buf.compare(begin, end - begin, "def"))
+    {
+        return tok_def;
+    }
+    if (0 == buf.compare(begin, end - begin, "extern"))
+    {
+        return tok_extern;
+    }
+    return tok_identifier;
+}
+
+/******************************************************************************/
+
+/*!
+ * @brief This function appends a chunk of the input.
+ */
+void
+StreamParser::feed (const char * p_data, size_t len)
+{
+    // Drop the input of the items already parsed once it is most of the
+    // buffer, so that a long session holds only its unparsed tail.
+    if (item_begin >= min_compact_bytes && item_begin * 2 >= buf.size())
+    {
+        buf.erase(0, item_begin);
+        scan_pos -= item_begin;
+        tok_start -= item_begin;
+        item_begin = 0;
+    }
+
+    buf.append(p_data, len);
+}
+
+/*!
+ * @brief This function marks the end of the input.
+ */
+void
+StreamParser::finish (void)
+{
+    finished = true;
+}
+
+/*!
+ * @brief This function scans the next token from the buffered input, as
+ *          gettok() would lex it.
+ *
+ * @return False if the input runs out first. The scan resumes from the same
+ *          character on the next call.
+ */
+bool
+StreamParser::scan_token (ScanToken& tok)
+{
+    while (scan_pos < buf.size())
+    {
+        int c = (unsigned char) buf[scan_pos];
+        switch (lex_state)
+        {
+            case lex_space:
+                if (isspace(c))
+                {
+                    ++scan_pos;
+                }
+                else if ('#' == c)
+                {
+                    lex_state = lex_comment;
+                    ++scan_pos;
+                }
+                else if (isalpha(c))
+                {
+                    lex_state = lex_identifier;
+                    tok_start = scan_pos++;
+                }
+                else if (isdigit(c) || '.' == c)
+                {
+                    lex_state = lex_number;
+                    tok_start = scan_pos++;
+                }
+                else
+                {
+                    tok = { c, scan_pos, scan_pos + 1 };
+                    ++scan_pos;
+                    return true;
+                }
+            break;
+
+            case lex_comment:
+                if ('\n' == c || '\r' == c)
+                {
+                    lex_state = lex_space;
+                }
+                ++scan_pos;
+            break;
+
+            case lex_identifier:
+                if (isalnum(c))
+                {
+                    ++scan_pos;
+                    continue;
+                }
+                lex_state = lex_space;
+                tok = { identifier_kind(buf, tok_start, scan_pos), tok_start, scan_pos };
+                return true;
+
+            case lex_number:
+                if (isdigit(c) || '.' == c)
+                {
+                    ++scan_pos;
+                    continue;
+                }
+                lex_state = lex_space;
+                tok = { tok_number, tok_start, scan_pos };
+                return true;
+        }
+    }
+
+    // Only the end of the input ends the last token.
+    if (!finished || lex_space == lex_state || lex_comment == lex_state)
+    {
+        return false;
+    }
+
+    int kind = lex_identifier == lex_state
+        ? identifier_kind(buf, tok_start, scan_pos)
+        : (int) tok_number;
+    tok = { kind, tok_start, scan_pos };
+    lex_state = lex_space;
+    return true;
+}
+
+/*!
+ * @brief This function advances the item being scanned over one token,
+ *          following the same grammar as the parse_* functions.
+ *
+ *          A token the grammar does not allow ends the item with it, so
+ *              that the parser reports the error where the REPL would.
+ */
+StreamParser::Step
+StreamParser::step (const ScanToken& tok)
+{
+    switch (item_state)
+    {
+        case item_start:
+            if (';' == tok.kind)
+            {
+                item_begin = tok.end;
+                return step_continue;
+            }
+            if (tok_def == tok.kind || tok_extern == tok.kind)
+            {
+                is_extern = tok_extern == tok.kind;
+                item_state = item_proto_name;
+                return step_continue;
+            }
+            item_state = item_operand;
+            return step(tok);
+
+        case item_proto_name:
+            if (tok_identifier != tok.kind)
+            {
+                return step_ends_after;
+            }
+            item_state = item_proto_open;
+            return step_continue;
+
+        case item_proto_open:
+            if ('(' != tok.kind)
+            {
+                return step_ends_after;
+            }
+            item_state = item_proto_args;
+            return step_continue;
+
+        case item_proto_args:
+            if (tok_identifier == tok.kind)
+            {
+                return step_continue;
+            }
+            if (')' != tok.kind || is_extern)
+            {
+                return step_ends_after;
+            }
+            item_state = item_operand;
+            return step_continue;
+
+        case item_operand_or_close:
+            if (')' == tok.kind)
+            {
+                --depth;
+                item_state = item_after_operand;
+                return step_continue;
+            }
+            // Fall through.
+
+        case item_operand:
+            switch (tok.kind)
+            {
+                case tok_number:
+                    item_state = item_after_operand;
+                    return step_continue;
+
+                case tok_identifier:
+                    item_state = item_after_identifier;
+                    return step_continue;
+
+                case '(':
+                    ++depth;
+                    return step_continue;
+
+                default:
+                    return step_ends_after;
+            }
+
+        case item_after_identifier:
+            if ('(' == tok.kind)
+            {
+                ++depth;
+                item_state = item_operand_or_close;
+                return step_continue;
+            }
+            // Fall through.
+
+        case item_after_operand:
+            if (get_binop_precedence(tok.kind) > 0)
+            {
+                item_state = item_operand;
+                return step_continue;
+            }
+            if (0 == depth)
+            {
+                return step_ends_before;
+            }
+            if (',' == tok.kind)
+            {
+                item_state = item_operand;
+                return step_continue;
+            }
+            if (')' == tok.kind)
+            {
+                --depth;
+                item_state = item_after_operand;
+                return step_continue;
+            }
+            return step_ends_after;
+    }
+
+    return step_ends_after;
+}
+
+/*!
+ * @brief This function parses the item that ends at the given offset, and
+ *          starts scanning the next one after it.
+ */
+StreamStatus
+StreamParser::parse_item (size_t end, StreamItem& item)
+{
+    lexer_set_input(buf.data() + item_begin, end - item_begin);
+    get_next_token();
+
+    item.kind = tok_def == cur_tok || tok_extern == cur_tok ? cur_tok : 0;
+    item.def.reset();
+    item.proto.reset();
+    switch (cur_tok)
+    {
+        case tok_def:
+            item.def = parse_definition();
+        break;
+
+        case tok_extern:
+            item.proto = parse_extern();
+        break;
+
+        default:
+            item.def = parse_top_level_expr();
+        break;
+    }
+
+    item_begin = end;
+    item_state = item_start;
+    depth = 0;
+    return item.def || item.proto ? stream_item : stream_error;
+}
+
+/*!
+ * @brief This function parses the next complete item, if the buffered
+ *          input holds one.
+ */
+StreamStatus
+StreamParser::next (StreamItem& item)
+{
+    ScanToken tok;
+    while (scan_token(tok))
+    {
+        switch (step(tok))
+        {
+            case step_continue:
+            break;
+
+            // The token starts the next item; scan it again from there.
+            case step_ends_before:
+                scan_pos = tok.begin;
+                return parse_item(tok.begin, item);
+
+            case step_ends_after:
+                return parse_item(tok.end, item);
+        }
+    }
+
+    if (!finished)
+    {
+        return stream_need_more;
+    }
+
+    if (item_start == item_state)
+    {
+        buf.clear();
+        buf.shrink_to_fit();
+        scan_pos = tok_start = item_begin = 0;
+        return stream_eof;
+    }
+
+    // Complete or not, the last item ends with the input.
+    return parse_item(buf.size(), item);
+}
+
+/***   end of file   ***/
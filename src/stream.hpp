@@ -0,0 +1,158 @@
+/*!
+ * @file src/stream.hpp
+ *
+ * @brief This file contains the resumable parser, which is fed source in
+ *          chunks of any size and never waits for input.
+ */
+
+#ifndef _LLVM_STREAM_H
+#define _LLVM_STREAM_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "ast.hpp"
+
+/*!
+ * @brief This enum contains the results of StreamParser::next().
+ */
+enum StreamStatus
+{
+    stream_item,        // A top-level item was parsed.
+    stream_error,       // A top-level item failed to parse and was skipped.
+    stream_need_more,   // The buffered input ends inside an item.
+    stream_eof,         // The input is finished and fully parsed.
+};
+
+/*!
+ * @brief This struct holds one parsed top-level item: a definition or
+ *          top-level expression in def, or an extern in proto.
+ */
+struct StreamItem
+{
+    int kind = 0;       // tok_def, tok_extern, or 0 for an expression.
+    std::unique_ptr<FunctionAST> def;
+    std::unique_ptr<PrototypeAST> proto;
+};
+
+/*!
+ * @brief This class parses one input that arrives in pieces, such as a
+ *          connection or a pipe, a top-level item at a time.
+ *
+ *          The input is scanned by a state machine that lexes a character
+ *              at a time and tracks just enough of the grammar to tell
+ *              where each item ends. Its state is a few words, so a token
+ *              or item split across chunks resumes exactly where the last
+ *              chunk stopped. Only a complete item is handed to the
+ *              recursive descent parser, which therefore never reaches the
+ *              end of the buffered input.
+ *
+ *          A session holds only the unparsed tail of its input, so one
+ *              thread can interleave thousands of them. An expression is
+ *              only known to be complete at the next token, so a trailing
+ *              ';' (or the next item, or finish()) is what releases it.
+ *
+ *          The parse itself uses the calling thread's lexer and parser
+ *              state, which must have its binary operators installed.
+ */
+class StreamParser
+{
+private:
+    // Where the character scanner is.
+    enum LexState
+    {
+        lex_space,
+        lex_comment,
+        lex_identifier,
+        lex_number,
+    };
+
+    // Where the item being scanned is in the grammar.
+    enum ItemState
+    {
+        item_start,             // Before the first token.
+        item_proto_name,        // After def or extern.
+        item_proto_open,        // After the prototype's name.
+        item_proto_args,        // In the prototype's argument names.
+        item_operand,           // An operand is due.
+        item_operand_or_close,  // After a call's '(': an argument or ')'.
+        item_after_identifier,  // After a name; '(' makes it a call.
+        item_after_operand,     // After a complete operand.
+    };
+
+    // What a token does to the item being scanned.
+    enum Step
+    {
+        step_continue,          // The item goes on.
+        step_ends_before,       // The item ended before the token.
+        step_ends_after,        // The item ends with the token.
+    };
+
+    // One scanned token, as a kind and a range of the buffer.
+    struct ScanToken
+    {
+        int kind;
+        size_t begin;
+        size_t end;
+    };
+
+    std::string buf;            // The unparsed input.
+    size_t scan_pos = 0;        // The next character to scan.
+    size_t tok_start = 0;       // The start of a token being scanned.
+    size_t item_begin = 0;      // The start of the item being scanned.
+    LexState lex_state = lex_space;
+    ItemState item_state = item_start;
+    unsigned depth = 0;         // Open parentheses in the item.
+    bool is_extern = false;     // The item is an extern.
+    bool finished = false;      // finish() has been called.
+
+    bool
+    scan_token (ScanToken& tok);
+
+    Step
+    step (const ScanToken& tok);
+
+    StreamStatus
+    parse_item (size_t end, StreamItem& item);
+
+public:
+    /*!
+     * @brief This function appends a chunk of the input.
+     */
+    void
+    feed (const char * p_data, size_t len);
+
+    /*!
+     * @brief This function marks the end of the input, so that a final item
+     *          without a terminator can complete.
+     */
+    void
+    finish (void);
+
+    /*!
+     * @brief This function parses the next complete item, if the buffered
+     *          input holds one.
+     *
+     * @param item Receives the item on stream_item.
+     *
+     * @return stream_need_more if feed() must be called first. Errors are
+     *          reported as the REPL reports them, and the rest of the input
+     *          is still parsed.
+     */
+    StreamStatus
+    next (StreamItem& item);
+
+    /*!
+     * @brief This function returns the bytes of input held, for accounting.
+     */
+    size_t
+    buffered (void) const
+    {
+        return buf.capacity();
+    }
+};
+
+#endif // _LLVM_STREAM_H
+
+/***   end of file   ***/
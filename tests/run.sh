@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# @file tests/run.sh
+#
+# @brief This script runs the compiler on small programs and checks what it
+#          prints, for the bugs a benchmark would not notice.
+#
+#          Each tests/NAME.ks is fed to the REPL with the options on its
+#              first line, after "# args:", and the messages it prints,
+#              without the prompts, must match tests/NAME.out. A crash
+#              fails the test. The files in tests/jobs must compile to the
+#              same objects with --jobs 1 and --jobs 4.
+#
+#          Usage: tests/run.sh [KALEIDOSCOPE]
+#
+
+prog=${1:-bins/kaleidoscope}
+prog=$(cd "$(dirname "$prog")" && pwd)/$(basename "$prog")
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+for ks in "$dir"/*.ks; do
+    name=$(basename "$ks" .ks)
+    args=$(sed -n '1s/^# args://p' "$ks")
+
+    # The aot engine writes its executable to the scratch directory.
+    (cd "$tmp" && "$prog" $args) < "$ks" > /dev/null 2> "$tmp/$name.err"
+    status=$?
+    sed -e 's/ready> //g' -e '/^$/d' "$tmp/$name.err" > "$tmp/$name.got"
+
+    if [ $status -ne 0 ]; then
+        echo "FAIL $name: exit status $status"
+        failed=1
+    elif ! diff -u "$dir/$name.out" "$tmp/$name.got"; then
+        echo "FAIL $name"
+        failed=1
+    else
+        echo "ok   $name"
+    fi
+done
+
+# The files in tests/jobs compile to the same objects on one thread as on
+# four, whatever else each thread compiled before.
+for jobs in 1 4; do
+    mkdir "$tmp/jobs$jobs"
+    cp "$dir"/jobs/*.ks "$tmp/jobs$jobs"
+    if ! (cd "$tmp/jobs$jobs" && "$prog" --jobs $jobs *.ks 2> /dev/null); then
+        echo "FAIL jobs: --jobs $jobs"
+        failed=1
+    fi
+done
+same=ok
+for obj in "$tmp"/jobs1/*.o; do
+    if ! cmp -s "$obj" "$tmp/jobs4/$(basename "$obj")"; then
+        echo "FAIL jobs: $(basename "$obj") differs with --jobs 4"
+        same=
+        failed=1
+    fi
+done
+[ -n "$same" ] && echo "ok   jobs"
+
+exit $failed
+
+#***   end of file   ***